@@ -0,0 +1,45 @@
+// Shared helpers for the benchmark guests (RV32I, freestanding).
+#pragma once
+
+#include <stdint.h>
+#ifndef __riscv
+#include <stdio.h>  // Native build, used to produce reference checksums.
+#endif
+
+// Print a signed integer through ecall 100.
+static void putInt(int n) {
+#ifdef __riscv
+  asm volatile(
+      "li a0, 100\n"
+      "li a7, 0\n"
+      "mv a1, %0\n"
+      "ecall\n"
+      :
+      : "r"(n)
+      : "a0", "a1", "a7");
+#else
+  printf(">> %d\n", n);
+#endif
+}
+
+// Deterministic pseudo-random numbers (LCG).
+static uint32_t lcg_state = 12345;
+static uint32_t lcgNext() {
+  lcg_state = lcg_state * 1103515245u + 12345u;
+  return lcg_state >> 8;
+}
+
+// Fold a value into a running checksum.
+static uint32_t mix(uint32_t h, uint32_t v) {
+  h ^= v;
+  h = (h << 5) | (h >> 27);
+  return h + 0x9e3779b9u;
+}
+
+// Each benchmark prints its checksum last; bench.sh compares it with
+// baseline.txt.
+#define BENCH_RESULT(h) \
+  do {                  \
+    putInt((int)(h));   \
+    return 0;           \
+  } while (0)
@@ -0,0 +1,161 @@
+#!/bin/bash
+# Guest benchmark suite: builds each guest with link.ld and bench/start.s,
+# builds a batch-mode emulator for it, and reports emulated MIPS and wall time
+# against bench/baseline.txt.
+#
+#   bench/bench.sh               run everything
+#   bench/bench.sh sort micro_op run a subset
+#   bench/bench.sh --update      record the current MIPS as the new baseline
+#
+# Environment: ARCH (guest -march, default rv32i), ABI (guest -mabi, default
+# ilp32), THRESH (allowed slowdown in percent before a run is flagged, default
+# 10), REPEAT (runs per benchmark, the fastest counts, default 3), CC (guest
+# compiler).
+
+cd "$(dirname "$0")/.." || exit 1
+
+ARCH=${ARCH:-rv32i}
+ABI=${ABI:-ilp32}
+THRESH=${THRESH:-10}
+REPEAT=${REPEAT:-3}
+CC=${CC:-riscv32-unknown-elf-gcc}
+OUT=bench/build
+BASELINE=bench/baseline.txt
+CFLAGS="-O2 -march=$ARCH -mabi=$ABI -ffreestanding -nostartfiles -Tlink.ld -fno-tree-loop-distribute-patterns"
+# Emulator sources and libraries, as listed in pjc.
+EMU_SRCS=$(sed -n 's/^gcc \(.*\) -o main\(.*\)$/\1\2/p' pjc.txt)
+
+WORKLOADS="intmath sort memops recurse fsm dhry core"
+MICRO="op opimm upper load store branch jal csr"
+MICRO_ITERS=20000
+
+UPDATE=0
+if [ "$1" == "--update" ]; then
+    UPDATE=1
+    shift
+fi
+NAMES="$*"
+if [ -z "$NAMES" ]; then
+    NAMES="$WORKLOADS"
+    for m in $MICRO; do NAMES="$NAMES micro_$m"; done
+fi
+
+# One instruction of the given handler class, repeated in the micro loops.
+microInst() {
+    case $1 in
+        op)     echo "add t0, t1, t2" ;;
+        opimm)  echo "addi t0, t1, 1" ;;
+        upper)  echo "lui t0, 0x12345" ;;
+        load)   echo "lw t0, 0(s1)" ;;
+        store)  echo "sw t0, 0(s1)" ;;
+        branch) echo "beq zero, zero, NEXT" ;;  # Taken, to the next one.
+        jal)    echo "jal zero, NEXT" ;;
+        csr)    echo "rdinstret t0" ;;
+    esac
+}
+
+# Write a micro benchmark: 32 copies of one instruction in a counted loop.
+genMicro() {
+    echo ".section .text"
+    echo ".global _start"
+    echo "_start:"
+    echo "    la sp, __stack_top"
+    echo "    la s1, buf"
+    echo "    li s0, $MICRO_ITERS"
+    echo "1:"
+    for i in $(seq 32); do
+        local inst=$(microInst $1)
+        echo "    ${inst/NEXT/.Lnext$i}"
+        echo ".Lnext$i:"
+    done
+    echo "    addi s0, s0, -1"
+    echo "    bnez s0, 1b"
+    echo "    li a0, 0"
+    echo "    li a1, 0"
+    echo "    li a7, 0"
+    echo "    ecall"
+    echo ".section .data"
+    echo "buf: .word 0"
+}
+
+# Build guest and emulator for one benchmark into $OUT/$1.
+build() {
+    local name=$1 dir=$OUT/$1
+    mkdir -p "$dir"
+    if [[ $name == micro_* ]]; then
+        genMicro "${name#micro_}" > "$dir/$name.s"
+        $CC $CFLAGS "$dir/$name.s" -o "$dir/rvelf" || return 1
+    else
+        $CC $CFLAGS bench/start.s "bench/$name.c" -o "$dir/rvelf" || return 1
+    fi
+    (cd "$dir" && xxd -i rvelf > rvelf.h)
+    gcc -O2 -DBATCH -DELF_HEADER="\"$dir/rvelf.h\"" $EMU_SRCS -o "$dir/emu"
+}
+
+baseline() {  # baseline <name> <field: 2 checksum, 3 mips>
+    awk -v n="$1" -v f="$2" '$1 == n { print $f }' "$BASELINE" 2>/dev/null
+}
+
+status=0
+results=""
+printf "%-14s %12s %10s %9s %9s %8s  %s\n" benchmark instret "wall ms" MIPS base "delta" "ns/inst"
+for name in $NAMES; do
+    if ! build "$name"; then
+        echo "$name: build failed"
+        status=1
+        continue
+    fi
+    inst=
+    for r in $(seq $REPEAT); do
+        log=$("$OUT/$name/emu")
+        stats=$(echo "$log" | sed -n 's/^retired \([0-9]*\) instructions in \([0-9]*\) us.*/\1 \2/p')
+        [ -z "$stats" ] && break
+        if [ -z "$inst" ] || [ "${stats#* }" -lt "$us" ]; then
+            inst=${stats% *}
+            us=${stats#* }
+        fi
+    done
+    if [ -z "$stats" ]; then
+        echo "$name: no result"
+        status=1
+        continue
+    fi
+    sum=$(echo "$log" | sed -n 's/^>> //p' | tail -1)
+    sum=${sum:--}
+    mips=$(awk -v i="$inst" -v u="$us" 'BEGIN { printf "%.2f", u ? i / u : 0 }')
+    nsi=$(awk -v i="$inst" -v u="$us" 'BEGIN { printf "%.1f", i ? u * 1000 / i : 0 }')
+    base=$(baseline "$name" 3)
+    note=""
+    delta="-"
+    if [[ $base =~ ^[0-9.]+$ ]]; then
+        delta=$(awk -v m="$mips" -v b="$base" 'BEGIN { printf "%+.1f%%", (m / b - 1) * 100 }')
+        if awk -v m="$mips" -v b="$base" -v t="$THRESH" 'BEGIN { exit !(m < b * (1 - t / 100)) }'; then
+            note="REGRESSION"
+            status=1
+        fi
+    fi
+    expect=$(baseline "$name" 2)
+    if [ -n "$expect" ] && [ "$expect" != "-" ] && [ "$expect" != "$sum" ]; then
+        note="$note WRONG CHECKSUM $sum (expected $expect)"
+        status=1
+    fi
+    printf "%-14s %12s %10.1f %9s %9s %8s  %7s %s\n" "$name" "$inst" \
+        "$(awk -v u="$us" 'BEGIN { print u / 1000 }')" "$mips" "${base:--}" "$delta" "$nsi" "$note"
+    results="$results$name ${expect:-$sum} $mips\n"
+done
+
+if [ $UPDATE == 1 ]; then
+    {
+        echo "# benchmark checksum mips   (bench/bench.sh --update, ARCH=$ARCH; host-specific, re-record per machine)"
+        echo "# A mips of - is unrecorded: the row only checks the checksum."
+        echo "# micro_* rows run one handler class in a guest loop and time the whole"
+        echo "# interpreter loop; -DHOST_PERF gives host time per handler."
+        # Keep entries for benchmarks that were not run this time.
+        grep -v '^#' "$BASELINE" 2>/dev/null | while read -r n rest; do
+            [[ " $NAMES " == *" $n "* ]] || echo "$n $rest"
+        done
+        printf "$results"
+    } > "$BASELINE.new" && mv "$BASELINE.new" "$BASELINE"
+    echo "baseline updated"
+fi
+exit $status
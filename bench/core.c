@@ -0,0 +1,86 @@
+// CoreMark-style mix: linked-list search and reversal, matrix arithmetic,
+// and a CRC16 over the intermediate results.
+#include "bench.h"
+
+#define LIST_LEN 128
+#define MAT_N 10
+#define ITERS 40
+
+typedef struct Node {
+  struct Node* next;
+  int16_t key, data;
+} Node;
+
+Node nodes[LIST_LEN];
+int16_t mat_a[MAT_N][MAT_N], mat_b[MAT_N][MAT_N];
+int32_t mat_c[MAT_N][MAT_N];
+
+uint16_t crc16(uint16_t crc, uint16_t v) {
+  for (int i = 0; i < 16; ++i) {
+    uint16_t bit = (crc ^ v) & 1;
+    crc >>= 1;
+    v >>= 1;
+    if (bit) crc ^= 0xa001;
+  }
+  return crc;
+}
+
+Node* listInit() {
+  for (int i = 0; i < LIST_LEN; ++i) {
+    nodes[i].next = i + 1 < LIST_LEN ? &nodes[i + 1] : 0;
+    nodes[i].key = i;
+    nodes[i].data = lcgNext() & 0x7fff;
+  }
+  return &nodes[0];
+}
+
+Node* listReverse(Node* head) {
+  Node* prev = 0;
+  while (head) {
+    Node* next = head->next;
+    head->next = prev;
+    prev = head;
+    head = next;
+  }
+  return prev;
+}
+
+Node* listFind(Node* head, int16_t key) {
+  while (head && head->key != key) head = head->next;
+  return head;
+}
+
+uint16_t matrixBench(uint16_t crc, int16_t val) {
+  for (int i = 0; i < MAT_N; ++i)
+    for (int j = 0; j < MAT_N; ++j) mat_a[i][j] += val;
+  for (int i = 0; i < MAT_N; ++i) {
+    for (int j = 0; j < MAT_N; ++j) {
+      int32_t sum = 0;
+      for (int k = 0; k < MAT_N; ++k) sum += mat_a[i][k] * mat_b[k][j];
+      mat_c[i][j] = sum;
+    }
+  }
+  for (int i = 0; i < MAT_N; ++i)
+    for (int j = 0; j < MAT_N; ++j) crc = crc16(crc, (uint16_t)mat_c[i][j]);
+  return crc;
+}
+
+int main() {
+  uint16_t crc = 0;
+  Node* head = listInit();
+  for (int i = 0; i < MAT_N; ++i) {
+    for (int j = 0; j < MAT_N; ++j) {
+      mat_a[i][j] = lcgNext() & 0xff;
+      mat_b[i][j] = lcgNext() & 0xff;
+    }
+  }
+  for (int it = 0; it < ITERS; ++it) {
+    for (int k = 0; k < 16; ++k) {
+      Node* n = listFind(head, (k * 37 + it) % (LIST_LEN + 8));
+      crc = crc16(crc, n ? (uint16_t)n->data : 0xffff);
+    }
+    head = listReverse(head);
+    crc = matrixBench(crc, (int16_t)it);
+  }
+  BENCH_RESULT(crc);
+}
@@ -0,0 +1,123 @@
+// Dhrystone-style mix: record updates through pointers, enum switches,
+// short string copies and compares, and small procedure calls.
+#include "bench.h"
+
+#define RUNS 3000
+
+typedef enum { IDENT_1, IDENT_2, IDENT_3, IDENT_4, IDENT_5 } Enumeration;
+
+typedef struct Record {
+  struct Record* next;
+  Enumeration discr;
+  Enumeration enum_comp;
+  int int_comp;
+  char str_comp[31];
+} Record;
+
+Record rec_a, rec_b;
+int int_glob;
+char char_glob_1, char_glob_2;
+int arr_1[50];
+int arr_2[50][50];
+char str_1[31], str_2[31];
+
+void strCopy(char* d, const char* s) {
+  while ((*d++ = *s++)) {
+  }
+}
+
+int strCompare(const char* a, const char* b) {
+  while (*a && *a == *b) ++a, ++b;
+  return (unsigned char)*a - (unsigned char)*b;
+}
+
+Enumeration func1(char c1, char c2) {
+  if (c1 != c2) return IDENT_1;
+  char_glob_1 = c1;
+  return IDENT_2;
+}
+
+int func2(const char* s1, const char* s2) {
+  int i = 2;
+  char c = 'A';
+  while (i <= 2) {
+    if (func1(s1[i], s2[i + 1]) == IDENT_1) {
+      c = 'A';
+      ++i;
+    }
+  }
+  if (c >= 'W' && c < 'Z') i = 7;
+  if (c == 'R') return 1;
+  if (strCompare(s1, s2) > 0) {
+    int_glob = i + 7;
+    return 1;
+  }
+  return 0;
+}
+
+Enumeration proc6(Enumeration e) {
+  switch (e) {
+    case IDENT_1: return IDENT_1;
+    case IDENT_2: return int_glob > 100 ? IDENT_1 : IDENT_4;
+    case IDENT_3: return IDENT_2;
+    case IDENT_4: return IDENT_3;
+    default: return IDENT_5;
+  }
+}
+
+void proc8(int* a1, int a2[50][50], int i1, int i2) {
+  int loc = i1 + 5;
+  a1[loc] = i2;
+  a1[loc + 1] = a1[loc];
+  a1[loc + 30] = loc;
+  for (int i = loc; i <= loc + 1; ++i) a2[loc][i] = loc;
+  a2[loc][loc - 1] += 1;
+  a2[loc + 20][loc] = a1[loc];
+  int_glob = 5;
+}
+
+void proc1(Record* p) {
+  Record* next = p->next;
+  next->int_comp = p->int_comp = 5;
+  next->discr = p->discr;
+  next->enum_comp = proc6(p->enum_comp);
+  next->next = p->next;
+  if (next->discr == IDENT_1) {
+    next->int_comp = 6;
+    next->enum_comp = proc6(p->enum_comp);
+    next->int_comp = p->int_comp + 10;
+  } else {
+    p->int_comp = next->int_comp;
+  }
+}
+
+int main() {
+  uint32_t h = 0;
+  rec_a.next = &rec_b;
+  rec_a.discr = IDENT_1;
+  rec_a.enum_comp = IDENT_3;
+  rec_a.int_comp = 40;
+  strCopy(rec_a.str_comp, "DHRYSTONE PROGRAM, SOME STRING");
+  strCopy(str_1, "DHRYSTONE PROGRAM, 1'ST STRING");
+
+  for (int run = 1; run <= RUNS; ++run) {
+    char_glob_1 = 'A';
+    char_glob_2 = 'B';
+    int i1 = 2, i2 = 3, i3;
+    strCopy(str_2, "DHRYSTONE PROGRAM, 2'ND STRING");
+    int ok = !func2(str_1, str_2);
+    while (i1 < i2) {
+      i3 = 5 * i1 - i2;
+      i1 += 1;
+    }
+    proc8(arr_1, arr_2, i1, i3);
+    proc1(&rec_a);
+    for (char c = 'A'; c <= char_glob_2; ++c) {
+      if (func1(c, 'C') == IDENT_2) i3 = run;
+    }
+    i2 = i2 * i1;
+    i1 = i2 / i3;
+    h = mix(h, i1 + i2 + i3 + ok + int_glob + rec_b.int_comp);
+  }
+  BENCH_RESULT(h);
+}
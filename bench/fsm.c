@@ -0,0 +1,65 @@
+// Branch-heavy state machine: tokenize generated text into words, numbers,
+// identifiers and punctuation.
+#include "bench.h"
+
+#define TEXT_LEN 12000
+
+char text[TEXT_LEN];
+
+enum State { S_SPACE, S_WORD, S_NUMBER, S_IDENT, S_HEX, S_COMMENT };
+
+void genText() {
+  static const char alphabet[] = " \t\nabcxyz_0123456789x#;,.()";
+  for (int i = 0; i < TEXT_LEN - 1; ++i)
+    text[i] = alphabet[lcgNext() % (sizeof(alphabet) - 1)];
+  text[TEXT_LEN - 1] = '\0';
+}
+
+uint32_t tokenize(const char* p) {
+  int counts[6] = {0};
+  uint32_t h = 0;
+  enum State s = S_SPACE;
+  for (; *p; ++p) {
+    char c = *p;
+    int alpha = (c >= 'a' && c <= 'z');
+    int digit = (c >= '0' && c <= '9');
+    switch (s) {
+      case S_SPACE:
+        if (c == '#') s = S_COMMENT;
+        else if (c == '0' && p[1] == 'x') s = S_HEX, ++p;
+        else if (digit) s = S_NUMBER;
+        else if (c == '_') s = S_IDENT;
+        else if (alpha) s = S_WORD;
+        else if (c != ' ' && c != '\t' && c != '\n') h = mix(h, c);
+        break;
+      case S_WORD:
+        if (c == '_' || digit) s = S_IDENT;
+        else if (!alpha) ++counts[S_WORD], s = S_SPACE;
+        break;
+      case S_IDENT:
+        if (!alpha && !digit && c != '_') ++counts[S_IDENT], s = S_SPACE;
+        break;
+      case S_NUMBER:
+        if (!digit) ++counts[S_NUMBER], s = S_SPACE;
+        break;
+      case S_HEX:
+        if (!digit && !(c >= 'a' && c <= 'f')) ++counts[S_HEX], s = S_SPACE;
+        break;
+      case S_COMMENT:
+        if (c == '\n') ++counts[S_COMMENT], s = S_SPACE;
+        break;
+    }
+  }
+  for (int i = 0; i < 6; ++i) h = mix(h, counts[i]);
+  return h;
+}
+
+int main() {
+  uint32_t h = 0;
+  genText();
+  for (int r = 0; r < 6; ++r) {
+    text[r * 7] = '#';
+    h = mix(h, tokenize(text));
+  }
+  BENCH_RESULT(h);
+}
@@ -0,0 +1,51 @@
+// Integer-heavy kernels: bitwise CRC32 and a small matrix multiply.
+#include "bench.h"
+
+#define BUF_LEN 2048
+#define N 12
+
+uint8_t buf[BUF_LEN];
+int32_t ma[N][N], mb[N][N], mc[N][N];
+
+uint32_t crc32(const uint8_t* p, int len) {
+  uint32_t crc = 0xffffffffu;
+  for (int i = 0; i < len; ++i) {
+    crc ^= p[i];
+    for (int k = 0; k < 8; ++k) crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1));
+  }
+  return ~crc;
+}
+
+void matmul() {
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < N; ++j) {
+      int32_t sum = 0;
+      for (int k = 0; k < N; ++k) sum += ma[i][k] * mb[k][j];
+      mc[i][j] = sum;
+    }
+  }
+}
+
+int main() {
+  uint32_t h = 0;
+  for (int i = 0; i < BUF_LEN; ++i) buf[i] = lcgNext();
+  for (int r = 0; r < 8; ++r) {
+    buf[r] ^= r;
+    h = mix(h, crc32(buf, BUF_LEN));
+  }
+
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < N; ++j) {
+      ma[i][j] = (int32_t)(lcgNext() & 0xff) - 128;
+      mb[i][j] = (int32_t)(lcgNext() & 0xff) - 128;
+    }
+  }
+  for (int r = 0; r < 20; ++r) {
+    matmul();
+    for (int i = 0; i < N; ++i) {
+      h = mix(h, mc[i][(i + r) % N]);
+      ma[i][r % N] = mc[i][i] >> 4;
+    }
+  }
+  BENCH_RESULT(h);
+}
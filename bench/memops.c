@@ -0,0 +1,47 @@
+// Bulk memory loops: byte and word memcpy/memset written out by hand.
+// Build with -fno-tree-loop-distribute-patterns so they stay loops.
+#include "bench.h"
+
+#define LEN 8192
+
+// Word storage so the word loops are aligned; bytes are reached through
+// uint8_t pointers, which may alias anything.
+uint32_t src_w[LEN / 4], dst_w[LEN / 4];
+
+void copyBytes(uint8_t* d, const uint8_t* s, int n) {
+  for (int i = 0; i < n; ++i) d[i] = s[i];
+}
+
+void copyWords(uint32_t* d, const uint32_t* s, int n) {
+  for (int i = 0; i < n; ++i) d[i] = s[i];
+}
+
+void setBytes(uint8_t* d, uint8_t v, int n) {
+  for (int i = 0; i < n; ++i) d[i] = v;
+}
+
+void setWords(uint32_t* d, uint32_t v, int n) {
+  for (int i = 0; i < n; ++i) d[i] = v;
+}
+
+uint32_t sum(const uint32_t* p, int n) {
+  uint32_t h = 0;
+  for (int i = 0; i < n; ++i) h += p[i] ^ (h >> 3);
+  return h;
+}
+
+int main() {
+  uint8_t* src = (uint8_t*)src_w;
+  uint8_t* dst = (uint8_t*)dst_w;
+  uint32_t h = 0;
+  for (int i = 0; i < LEN; ++i) src[i] = lcgNext();
+  for (int r = 0; r < 8; ++r) {
+    setBytes(dst, r, LEN);
+    copyBytes(dst + r, src, LEN - 8);
+    h = mix(h, sum(dst_w, LEN / 4));
+    setWords(dst_w, 0x01010101u * r, LEN / 4);
+    copyWords(dst_w, src_w + r, LEN / 4 - 8);
+    h = mix(h, sum(dst_w, LEN / 4));
+  }
+  BENCH_RESULT(h);
+}
@@ -0,0 +1,23 @@
+// Call-heavy recursion: naive Fibonacci, Ackermann and Takeuchi.
+#include "bench.h"
+
+int fib(int n) { return n < 2 ? n : fib(n - 1) + fib(n - 2); }
+
+int ack(int m, int n) {
+  if (m == 0) return n + 1;
+  if (n == 0) return ack(m - 1, 1);
+  return ack(m - 1, ack(m, n - 1));
+}
+
+int tak(int x, int y, int z) {
+  if (y >= x) return z;
+  return tak(tak(x - 1, y, z), tak(y - 1, z, x), tak(z - 1, x, y));
+}
+
+int main() {
+  uint32_t h = 0;
+  h = mix(h, fib(20));
+  h = mix(h, ack(2, 60));
+  h = mix(h, tak(12, 8, 4));
+  BENCH_RESULT(h);
+}
@@ -0,0 +1,68 @@
+// Sorting: quicksort over a large array, insertion sort over a small one.
+#include "bench.h"
+
+#define BIG 4000
+#define SMALL 400
+
+int32_t big[BIG];
+int32_t small[SMALL];
+
+void quicksort(int32_t* a, int lo, int hi) {
+  while (lo < hi) {
+    int32_t pivot = a[(lo + hi) / 2];
+    int i = lo, j = hi;
+    while (i <= j) {
+      while (a[i] < pivot) ++i;
+      while (a[j] > pivot) --j;
+      if (i <= j) {
+        int32_t t = a[i];
+        a[i] = a[j];
+        a[j] = t;
+        ++i;
+        --j;
+      }
+    }
+    // Recurse into the smaller half to bound stack depth.
+    if (j - lo < hi - i) {
+      quicksort(a, lo, j);
+      lo = i;
+    } else {
+      quicksort(a, i, hi);
+      hi = j;
+    }
+  }
+}
+
+void insertionSort(int32_t* a, int n) {
+  for (int i = 1; i < n; ++i) {
+    int32_t v = a[i];
+    int j = i - 1;
+    while (j >= 0 && a[j] > v) {
+      a[j + 1] = a[j];
+      --j;
+    }
+    a[j + 1] = v;
+  }
+}
+
+uint32_t check(const int32_t* a, int n) {
+  uint32_t h = 0;
+  for (int i = 0; i < n; ++i) {
+    if (i && a[i - 1] > a[i]) return 0;  // Not sorted.
+    h = mix(h, a[i]);
+  }
+  return h;
+}
+
+int main() {
+  uint32_t h = 0;
+  for (int r = 0; r < 2; ++r) {
+    for (int i = 0; i < BIG; ++i) big[i] = (int32_t)lcgNext() - (1 << 23);
+    quicksort(big, 0, BIG - 1);
+    h = mix(h, check(big, BIG));
+  }
+  for (int i = 0; i < SMALL; ++i) small[i] = lcgNext() & 0xffff;
+  insertionSort(small, SMALL);
+  h = mix(h, check(small, SMALL));
+  BENCH_RESULT(h);
+}
@@ -0,0 +1,13 @@
+.section .text
+.global _start
+
+# Benchmark startup: like startup.s, but without the ebreak that waits for a key.
+_start:
+    la sp, __stack_top
+    call main
+
+_exit:
+    mv a1, a0
+    li a0, 0
+    li a7, 0
+    ecall
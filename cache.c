@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "sym.h"
+
+typedef struct {
+  const char* name;
+  uint32_t size, sets, ways, line_shift;
+  uint32_t* tag;    // Line address (addr >> line_shift) per set and way.
+  uint8_t* valid;
+  uint8_t* dirty;
+  uint64_t* stamp;  // LRU: last use; FIFO: fill time.
+  uint64_t clock;
+  uint64_t accesses, misses, writebacks, mem_writes;
+} Cache;
+
+// Accesses and misses per guest pc (indexed by pc / 2).
+typedef struct {
+  uint32_t fetch, fetch_miss, data, data_miss;
+} CachePc;
+
+Cache icache = {.name = "I-cache"}, dcache = {.name = "D-cache"};
+CachePc* cache_pc = NULL;
+uint32_t cache_pcs = 0;
+uint32_t cache_rand = 2463534242u;
+
+#ifdef DCACHE_WRITE_THROUGH
+#define DCACHE_WRITE_BACK false
+#else
+#define DCACHE_WRITE_BACK true
+#endif
+
+uint32_t cacheLog2(uint32_t x) {
+  uint32_t n = 0;
+  while ((1u << (n + 1)) <= x) ++n;
+  return n;
+}
+
+void cacheInit(Cache* c, uint32_t size, uint32_t ways, uint32_t line) {
+  free(c->tag);
+  free(c->valid);
+  free(c->dirty);
+  free(c->stamp);
+  c->size = size;
+  c->ways = ways ? ways : 1;
+  c->line_shift = cacheLog2(line);
+  c->sets = size / (c->ways << c->line_shift);
+  if (!c->sets) c->sets = 1;
+  uint32_t n = c->sets * c->ways;
+  c->tag = calloc(n, sizeof(uint32_t));
+  c->valid = calloc(n, 1);
+  c->dirty = calloc(n, 1);
+  c->stamp = calloc(n, sizeof(uint64_t));
+  c->clock = c->accesses = c->misses = c->writebacks = c->mem_writes = 0;
+}
+
+void cacheReset(uint32_t mem_size) {
+  cacheInit(&icache, ICACHE_SIZE, ICACHE_WAYS, ICACHE_LINE);
+  cacheInit(&dcache, DCACHE_SIZE, DCACHE_WAYS, DCACHE_LINE);
+  free(cache_pc);
+  cache_pcs = mem_size / 2;
+  cache_pc = calloc(cache_pcs, sizeof(CachePc));
+}
+
+// Look up the line holding addr, filling it on a miss unless this is a
+// write-through store. Returns true on a hit.
+bool cacheAccess(Cache* c, uint32_t addr, bool store, bool write_back) {
+  uint32_t line = addr >> c->line_shift;
+  uint32_t base = (line % c->sets) * c->ways;
+  ++c->clock;
+  ++c->accesses;
+  for (uint32_t w = base; w < base + c->ways; ++w) {
+    if (!c->valid[w] || c->tag[w] != line) continue;
+    if (CACHE_REPL == CACHE_LRU) c->stamp[w] = c->clock;
+    if (store && write_back) c->dirty[w] = 1;
+    else if (store) ++c->mem_writes;
+    return true;
+  }
+  ++c->misses;
+  if (store && !write_back) {  // No write-allocate.
+    ++c->mem_writes;
+    return false;
+  }
+
+  // Victim: an invalid way, else by replacement policy.
+  uint32_t victim = base;
+  while (victim < base + c->ways && c->valid[victim]) ++victim;
+  if (victim == base + c->ways) {
+    victim = base;
+    if (CACHE_REPL == CACHE_RANDOM) {
+      cache_rand ^= cache_rand << 13;
+      cache_rand ^= cache_rand >> 17;
+      cache_rand ^= cache_rand << 5;
+      victim += cache_rand % c->ways;
+    } else {
+      for (uint32_t w = base + 1; w < base + c->ways; ++w)
+        if (c->stamp[w] < c->stamp[victim]) victim = w;
+    }
+  }
+  if (c->valid[victim] && c->dirty[victim]) ++c->writebacks;
+  c->tag[victim] = line;
+  c->valid[victim] = 1;
+  c->dirty[victim] = store;
+  c->stamp[victim] = c->clock;
+  return false;
+}
+
+// Access every line of [addr, addr + len).
+bool cacheRange(Cache* c, uint32_t addr, uint32_t len, bool store,
+                bool write_back) {
+  bool hit = cacheAccess(c, addr, store, write_back);
+  uint32_t last = addr + len - 1;
+  if ((last >> c->line_shift) != (addr >> c->line_shift))
+    hit &= cacheAccess(c, last, store, write_back);
+  return hit;
+}
+
+bool cacheFetch(uint32_t addr, uint32_t hi, uint32_t pc) {
+  bool hit = cacheAccess(&icache, addr, false, false);
+  if ((hi >> icache.line_shift) != (addr >> icache.line_shift))
+    hit &= cacheAccess(&icache, hi, false, false);
+  CachePc* p = &cache_pc[(pc / 2) % cache_pcs];
+  ++p->fetch;
+  p->fetch_miss += !hit;
+  return hit;
+}
+
+bool cacheData(uint32_t addr, uint32_t width, bool store, uint32_t pc) {
+  bool hit = cacheRange(&dcache, addr, width, store, DCACHE_WRITE_BACK);
+  CachePc* p = &cache_pc[(pc / 2) % cache_pcs];
+  ++p->data;
+  p->data_miss += !hit;
+  return hit;
+}
+
+double cachePct(uint64_t n, uint64_t d) { return d ? 100.0 * n / d : 0.0; }
+
+void cachePrint(const Cache* c) {
+  printf("%-8s %7uK %5u %5u %12llu %12llu %7.2f%% %12llu\n", c->name,
+         c->size / 1024, c->ways, 1u << c->line_shift,
+         (unsigned long long)c->accesses, (unsigned long long)c->misses,
+         cachePct(c->misses, c->accesses),
+         (unsigned long long)(c->writebacks + c->mem_writes));
+}
+
+// Sort index arrays by misses, most first.
+const CachePc* cache_sort_pc;
+int cachePcCmp(const void* a, const void* b) {
+  const CachePc *x = &cache_sort_pc[*(const uint32_t*)a],
+                *y = &cache_sort_pc[*(const uint32_t*)b];
+  uint64_t mx = (uint64_t)x->fetch_miss + x->data_miss,
+           my = (uint64_t)y->fetch_miss + y->data_miss;
+  return (mx < my) - (mx > my);
+}
+
+void cachePcLine(const char* name, const CachePc* p) {
+  printf("%-24.24s %10u %6.2f%% %10u %6.2f%%\n", name, p->fetch_miss,
+         cachePct(p->fetch_miss, p->fetch), p->data_miss,
+         cachePct(p->data_miss, p->data));
+}
+
+void cacheDump() {
+  if (!cache_pc) return;
+  static const char* repl[] = {"LRU", "FIFO", "random"};
+  printf("\nCache model (%s replacement, D-cache %s)\n", repl[CACHE_REPL],
+         DCACHE_WRITE_BACK ? "write-back" : "write-through");
+  printf("%-8s %8s %5s %5s %12s %12s %8s %12s\n", "cache", "size", "ways",
+         "line", "accesses", "misses", "miss", "mem writes");
+  cachePrint(&icache);
+  cachePrint(&dcache);
+
+  // Per pc, then per function.
+  uint32_t* idx = malloc(cache_pcs * sizeof(uint32_t));
+  CachePc* fn = calloc(sym_num + 1, sizeof(CachePc));  // Last: unknown.
+  if (!idx || !fn) {
+    free(idx);
+    free(fn);
+    return;
+  }
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < cache_pcs; ++i) {
+    const CachePc* p = &cache_pc[i];
+    if (!p->fetch && !p->data) continue;
+    if (p->fetch_miss || p->data_miss) idx[n++] = i;
+    int s = symLookup(i * 2);
+    CachePc* f = &fn[s == SYM_NONE ? sym_num : s];
+    f->fetch += p->fetch;
+    f->fetch_miss += p->fetch_miss;
+    f->data += p->data;
+    f->data_miss += p->data_miss;
+  }
+  cache_sort_pc = cache_pc;
+  qsort(idx, n, sizeof(uint32_t), cachePcCmp);
+  printf("%-24s %10s %7s %10s %7s\n", "pc", "I misses", "rate", "D misses",
+         "rate");
+  for (uint32_t k = 0; k < n && k < CACHE_TOP; ++k) {
+    char name[40];
+    snprintf(name, sizeof(name), "0x%x %s", idx[k] * 2, symName(idx[k] * 2));
+    cachePcLine(name, &cache_pc[idx[k]]);
+  }
+
+  n = 0;
+  for (int s = 0; s <= sym_num; ++s)
+    if (fn[s].fetch_miss || fn[s].data_miss) idx[n++] = s;
+  if (n && sym_num) {
+    cache_sort_pc = fn;
+    qsort(idx, n, sizeof(uint32_t), cachePcCmp);
+    printf("%-24s %10s %7s %10s %7s\n", "function", "I misses", "rate",
+           "D misses", "rate");
+    for (uint32_t k = 0; k < n && k < CACHE_TOP; ++k)
+      cachePcLine(idx[k] == (uint32_t)sym_num ? "??" : syms[idx[k]].name,
+                  &fn[idx[k]]);
+  }
+  free(idx);
+  free(fn);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// L1 instruction and data cache model, enabled with -DCACHE_SIM.
+// Fed by every instruction fetch and every handleLoad/handleStore access.
+// Geometry, replacement and write policy are set at compile time; hit and
+// miss counts are reported per cache, per pc and per function at exit.
+
+#ifndef ICACHE_SIZE
+#define ICACHE_SIZE 16384  // Bytes.
+#endif
+#ifndef ICACHE_WAYS
+#define ICACHE_WAYS 2
+#endif
+#ifndef ICACHE_LINE
+#define ICACHE_LINE 32  // Bytes, power of two.
+#endif
+#ifndef DCACHE_SIZE
+#define DCACHE_SIZE 16384
+#endif
+#ifndef DCACHE_WAYS
+#define DCACHE_WAYS 4
+#endif
+#ifndef DCACHE_LINE
+#define DCACHE_LINE 32
+#endif
+
+enum CacheRepl { CACHE_LRU, CACHE_FIFO, CACHE_RANDOM };
+#ifndef CACHE_REPL
+#define CACHE_REPL CACHE_LRU
+#endif
+
+// Data cache writes: write-back with write-allocate, or write-through
+// without allocation (-DDCACHE_WRITE_THROUGH).
+
+#ifndef CACHE_TOP
+#define CACHE_TOP 16  // Pcs and functions listed at exit.
+#endif
+
+// Clear both caches and the statistics; mem_size bounds guest pcs.
+void cacheReset(uint32_t mem_size);
+
+// Fetch of the instruction at pc from physical address addr; hi is the
+// address of its upper halfword, or addr for a compressed one. Returns true
+// on a hit.
+bool cacheFetch(uint32_t addr, uint32_t hi, uint32_t pc);
+
+// Data access of width bytes at addr by the instruction at pc. Returns true
+// on a hit.
+bool cacheData(uint32_t addr, uint32_t width, bool store, uint32_t pc);
+
+void cacheDump();
@@ -0,0 +1,232 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "callprof.h"
+#include "sym.h"
+
+#define CALLPROF_UNKNOWN SYM_MAX  // Function id for pcs without a symbol.
+
+// Calling-context tree node.
+typedef struct {
+  int func;  // Symbol index or CALLPROF_UNKNOWN.
+  int parent, child, sibling;
+  uint64_t calls;
+  uint64_t incl_inst, excl_inst;
+  uint64_t incl_mem, excl_mem;
+} CallNode;
+
+typedef struct {
+  int node;
+  uint32_t ret;  // Expected return address.
+  uint64_t in_inst, in_mem;
+} CallFrame;
+
+CallNode call_nodes[CALLPROF_NODES];
+int call_node_num = 0;
+CallFrame call_stack[CALLPROF_DEPTH];
+int call_depth = 0;   // Frames on the stack, call_stack[0] is the root.
+int call_lost = 0;    // Calls deeper than CALLPROF_DEPTH.
+uint64_t call_last_inst = 0, call_last_mem = 0;
+uint64_t callprof_mem = 0;
+
+int callprofFunc(uint32_t addr) {
+  int i = symLookup(addr);
+  return i == SYM_NONE ? CALLPROF_UNKNOWN : i;
+}
+
+const char* callprofName(int func) {
+  return func == CALLPROF_UNKNOWN ? "??" : syms[func].name;
+}
+
+// Cost since start; 0 if now went back (-DREVERSE re-executes).
+uint64_t callprofSince(uint64_t now, uint64_t start) {
+  return now > start ? now - start : 0;
+}
+
+// Charge cost since the last event to the frame on top.
+void callprofCharge(uint64_t now) {
+  if (call_depth == 0) return;
+  CallNode* n = &call_nodes[call_stack[call_depth - 1].node];
+  n->excl_inst += callprofSince(now, call_last_inst);
+  n->excl_mem += callprof_mem - call_last_mem;
+  call_last_inst = now;
+  call_last_mem = callprof_mem;
+}
+
+void callprofPush(int node, uint32_t ret, uint64_t now) {
+  CallFrame* f = &call_stack[call_depth++];
+  f->node = node;
+  f->ret = ret;
+  f->in_inst = now;
+  f->in_mem = callprof_mem;
+  ++call_nodes[node].calls;
+}
+
+void callprofPop(uint64_t now) {
+  CallFrame* f = &call_stack[--call_depth];
+  call_nodes[f->node].incl_inst += callprofSince(now, f->in_inst);
+  call_nodes[f->node].incl_mem += callprof_mem - f->in_mem;
+}
+
+void callprofReset(uint32_t entry) {
+  memset(call_nodes, 0, sizeof(call_nodes));
+  call_nodes[0].func = callprofFunc(entry);
+  call_nodes[0].parent = call_nodes[0].child = call_nodes[0].sibling = -1;
+  call_node_num = 1;
+  call_depth = call_lost = 0;
+  call_last_inst = call_last_mem = callprof_mem = 0;
+  callprofPush(0, 0, 0);
+}
+
+void callprofCall(uint32_t target, uint32_t ret, uint64_t now) {
+  if (call_depth == CALLPROF_DEPTH) {
+    ++call_lost;
+    return;
+  }
+  callprofCharge(now);
+  if (call_depth == 0) return;
+  int parent = call_stack[call_depth - 1].node;
+  int func = callprofFunc(target);
+  int n = call_nodes[parent].child;
+  while (n != -1 && call_nodes[n].func != func) n = call_nodes[n].sibling;
+  if (n == -1) {
+    if (call_node_num == CALLPROF_NODES) {
+      ++call_lost;
+      return;
+    }
+    n = call_node_num++;
+    call_nodes[n].func = func;
+    call_nodes[n].parent = parent;
+    call_nodes[n].child = -1;
+    call_nodes[n].sibling = call_nodes[parent].child;
+    call_nodes[parent].child = n;
+  }
+  callprofPush(n, ret, now);
+}
+
+void callprofReturn(uint32_t target, uint64_t now) {
+  // Unwind to the frame expecting this return address, if any, so that
+  // longjmp-style exits do not leave stale frames behind.
+  int d = call_depth - 1;
+  while (d > 0 && call_stack[d].ret != target) --d;
+  if (d == 0) return;
+  callprofCharge(now);
+  while (call_depth > d) callprofPop(now);
+}
+
+// Per-function totals, with recursive activations counted once inclusively.
+typedef struct {
+  int func;
+  uint64_t calls, incl_inst, excl_inst, incl_mem, excl_mem;
+} CallFunc;
+
+CallFunc call_funcs[SYM_MAX + 1];
+
+// Caller -> callee edge, merged over all calling contexts.
+typedef struct {
+  int caller, callee;
+  uint64_t calls, incl_inst;
+} CallEdge;
+
+CallEdge call_edges[CALLPROF_NODES];
+
+int callprofEdgeCmp(const void* a, const void* b) {
+  const CallEdge *x = a, *y = b;
+  if (x->caller != y->caller) return x->caller - y->caller;
+  return x->callee - y->callee;
+}
+
+bool callprofRecursive(int n) {
+  for (int p = call_nodes[n].parent; p != -1; p = call_nodes[p].parent) {
+    if (call_nodes[p].func == call_nodes[n].func) return true;
+  }
+  return false;
+}
+
+int callprofCmp(const void* a, const void* b) {
+  uint64_t x = ((const CallFunc*)a)->incl_inst, y = ((const CallFunc*)b)->incl_inst;
+  return (x < y) - (x > y);  // Descending.
+}
+
+// Write the node's stack as "root;...;func".
+void callprofPath(FILE* f, int n) {
+  if (call_nodes[n].parent != -1) {
+    callprofPath(f, call_nodes[n].parent);
+    fputc(';', f);
+  }
+  fputs(callprofName(call_nodes[n].func), f);
+}
+
+void callprofDump(uint64_t now) {
+  // Close the open frames but keep them on the stack, so a later dump (after
+  // going back, or the next persistent fuzz input) continues from here.
+  callprofCharge(now);
+  for (int d = 0; d < call_depth; ++d) {
+    CallFrame* f = &call_stack[d];
+    call_nodes[f->node].incl_inst += callprofSince(now, f->in_inst);
+    call_nodes[f->node].incl_mem += callprof_mem - f->in_mem;
+    f->in_inst = now;
+    f->in_mem = callprof_mem;
+  }
+
+  memset(call_funcs, 0, sizeof(call_funcs));
+  for (int i = 0; i <= SYM_MAX; ++i) call_funcs[i].func = i;
+  int edge_num = 0;
+  for (int n = 0; n < call_node_num; ++n) {
+    CallNode* c = &call_nodes[n];
+    CallFunc* f = &call_funcs[c->func];
+    bool recursive = callprofRecursive(n);
+    f->calls += c->calls;
+    f->excl_inst += c->excl_inst;
+    f->excl_mem += c->excl_mem;
+    if (!recursive) {
+      f->incl_inst += c->incl_inst;
+      f->incl_mem += c->incl_mem;
+    }
+    if (c->parent == -1) continue;
+    CallEdge* e = &call_edges[edge_num++];
+    e->caller = call_nodes[c->parent].func;
+    e->callee = c->func;
+    e->calls = c->calls;
+    e->incl_inst = recursive ? 0 : c->incl_inst;
+  }
+  qsort(call_funcs, SYM_MAX + 1, sizeof(CallFunc), callprofCmp);
+
+  printf("\nCall profile (%llu instructions, %llu memory accesses)\n",
+         (unsigned long long)now, (unsigned long long)callprof_mem);
+  printf("%10s %12s %12s %12s %12s  %s\n", "calls", "incl inst",
+         "excl inst", "incl mem", "excl mem", "function");
+  for (int i = 0; i <= SYM_MAX && call_funcs[i].calls; ++i) {
+    CallFunc* f = &call_funcs[i];
+    printf("%10llu %12llu %12llu %12llu %12llu  %s\n",
+           (unsigned long long)f->calls, (unsigned long long)f->incl_inst,
+           (unsigned long long)f->excl_inst, (unsigned long long)f->incl_mem,
+           (unsigned long long)f->excl_mem, callprofName(f->func));
+  }
+
+  printf("\nCall graph\n%10s %12s  %s\n", "calls", "incl inst", "caller -> callee");
+  qsort(call_edges, edge_num, sizeof(CallEdge), callprofEdgeCmp);
+  for (int i = 0; i < edge_num;) {
+    CallEdge e = call_edges[i];
+    for (++i; i < edge_num && !callprofEdgeCmp(&e, &call_edges[i]); ++i) {
+      e.calls += call_edges[i].calls;
+      e.incl_inst += call_edges[i].incl_inst;
+    }
+    printf("%10llu %12llu  %s -> %s\n", (unsigned long long)e.calls,
+           (unsigned long long)e.incl_inst, callprofName(e.caller),
+           callprofName(e.callee));
+  }
+  if (call_lost) printf("%d calls not tracked (stack or tree full)\n", call_lost);
+
+  FILE* f = fopen(CALLPROF_FOLDED, "w");
+  if (!f) return;
+  for (int n = 0; n < call_node_num; ++n) {
+    if (call_nodes[n].excl_inst == 0) continue;
+    callprofPath(f, n);
+    fprintf(f, " %llu\n", (unsigned long long)call_nodes[n].excl_inst);
+  }
+  fclose(f);
+  printf("Collapsed stacks written to %s\n", CALLPROF_FOLDED);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// Shadow call-stack profiler, enabled with -DCALL_PROF.
+// Calls (jal/jalr with rd = ra or t0) and returns (jalr x0 through ra or t0)
+// build a calling-context tree. Retired instructions and memory accesses are
+// charged to its nodes at each call and return, so nothing runs per
+// instruction. At exit, inclusive/exclusive cost per function and the call
+// graph are printed, and instruction-weighted stacks are written for
+// flamegraph.pl.
+
+#ifndef CALLPROF_NODES
+#define CALLPROF_NODES 65536  // Distinct calling contexts.
+#endif
+#ifndef CALLPROF_DEPTH
+#define CALLPROF_DEPTH 1024   // Shadow stack depth.
+#endif
+#ifndef CALLPROF_FOLDED
+#define CALLPROF_FOLDED "callprof.folded"
+#endif
+
+// Loads and stores executed so far; bumped by handleLoad/handleStore.
+extern uint64_t callprof_mem;
+
+// Start a new profile rooted at the entry point.
+void callprofReset(uint32_t entry);
+
+// Guest called target, returning to ret. now is the retired-instruction count.
+void callprofCall(uint32_t target, uint32_t ret, uint64_t now);
+
+// Guest returned to target.
+void callprofReturn(uint32_t target, uint64_t now);
+
+// Charge open frames and print the report; they stay open, so the guest
+// can run on and be dumped again.
+void callprofDump(uint64_t now);
@@ -0,0 +1,479 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cov.h"
+#include "elf.h"
+#include "rvc.h"
+#include "sym.h"
+
+#define COV_FILES 1024  // Source files across all compilation units.
+#define COV_DIRS 256    // Directories / files per compilation unit.
+
+uint8_t* cov_exec = NULL;
+uint8_t* cov_taken = NULL;
+uint8_t* cov_fall = NULL;
+uint32_t cov_mem_size = 0;
+
+void covReset(uint32_t mem_size) {
+  free(cov_exec);
+  free(cov_taken);
+  free(cov_fall);
+  uint32_t bytes = mem_size / 16 + 1;
+  cov_exec = calloc(bytes, 1);
+  cov_taken = calloc(bytes, 1);
+  cov_fall = calloc(bytes, 1);
+  cov_mem_size = mem_size;
+}
+
+// Length of the instruction at addr; sets branch for conditional branches.
+uint32_t covInst(const uint8_t* mem, uint32_t addr, bool* branch) {
+  uint16_t lo;
+  uint32_t inst, len = 4;
+  memcpy(&lo, &mem[addr], 2);
+  if (IS_RVC(lo)) {
+    inst = RVC_EXPAND(lo);
+    len = 2;
+  } else {
+    memcpy(&inst, &mem[addr], 4);
+  }
+  *branch = (inst & 0b1111111) == 0b1100011;
+  return len;
+}
+
+// Instructions, executed ones, branch outcomes and covered outcomes in
+// [lo, hi).
+typedef struct {
+  uint32_t insts, hit, outcomes, outcomes_hit;
+} CovCount;
+
+void covCount(const uint8_t* mem, uint32_t lo, uint32_t hi, CovCount* c) {
+  if (hi > cov_mem_size - 4) hi = cov_mem_size - 4;
+  for (uint32_t a = lo & ~1u, n; a < hi; a += n) {
+    bool branch;
+    n = covInst(mem, a, &branch);
+    ++c->insts;
+    c->hit += COV_TEST(cov_exec, a);
+    if (branch) {
+      c->outcomes += 2;
+      c->outcomes_hit += COV_TEST(cov_taken, a) + COV_TEST(cov_fall, a);
+    }
+  }
+}
+
+double covPct(uint32_t n, uint32_t d) { return d ? 100.0 * n / d : 0.0; }
+
+// Section data by name, or NULL.
+const uint8_t* covSection(const uint8_t* elf, uint32_t len, const char* name,
+                          uint32_t* size) {
+  const Elf32_Ehdr* elf_h = (const Elf32_Ehdr*)elf;
+  if (elf_h->e_shoff == 0 || elf_h->e_shentsize != sizeof(Elf32_Shdr) ||
+      elf_h->e_shoff + elf_h->e_shnum * sizeof(Elf32_Shdr) > len ||
+      elf_h->e_shstrndx >= elf_h->e_shnum)
+    return NULL;
+  const Elf32_Shdr* sh = (const Elf32_Shdr*)(elf + elf_h->e_shoff);
+  const Elf32_Shdr* names = &sh[elf_h->e_shstrndx];
+  for (int i = 0; i < elf_h->e_shnum; ++i) {
+    if (sh[i].sh_name >= names->sh_size ||
+        names->sh_offset + names->sh_size > len ||
+        sh[i].sh_offset + sh[i].sh_size > len)
+      continue;
+    if (!strncmp((const char*)elf + names->sh_offset + sh[i].sh_name, name,
+                 names->sh_size - sh[i].sh_name)) {
+      *size = sh[i].sh_size;
+      return elf + sh[i].sh_offset;
+    }
+  }
+  return NULL;
+}
+
+// DWARF reader with bounds: reads past the end yield 0 and stop at end.
+typedef struct {
+  const uint8_t *p, *end;
+} CovRd;
+
+uint64_t covU(CovRd* r, int n) {
+  uint64_t v = 0;
+  if (r->p + n > r->end) {
+    r->p = r->end;
+    return 0;
+  }
+  for (int i = 0; i < n; ++i) v |= (uint64_t)r->p[i] << (8 * i);
+  r->p += n;
+  return v;
+}
+
+uint64_t covUleb(CovRd* r) {
+  uint64_t v = 0;
+  for (int shift = 0; r->p < r->end; shift += 7) {
+    uint8_t b = *r->p++;
+    if (shift < 64) v |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) break;
+  }
+  return v;
+}
+
+int64_t covSleb(CovRd* r) {
+  int64_t v = 0;
+  int shift = 0;
+  uint8_t b = 0;
+  while (r->p < r->end) {
+    b = *r->p++;
+    if (shift < 64) v |= (int64_t)(b & 0x7f) << shift;
+    shift += 7;
+    if (!(b & 0x80)) break;
+  }
+  if (shift < 64 && (b & 0x40)) v |= -((int64_t)1 << shift);
+  return v;
+}
+
+// NUL-terminated string at p inside [p, end), or NULL.
+const char* covStr(const uint8_t* p, const uint8_t* end) {
+  return p < end && memchr(p, 0, end - p) ? (const char*)p : NULL;
+}
+
+// String sections referenced by DWARF 5 line headers.
+typedef struct {
+  const uint8_t *line_str, *str;
+  uint32_t line_str_size, str_size;
+} CovStrs;
+
+// Read one DW_FORM_* value: a string (or NULL) and/or its number.
+// Returns false on an unsupported form.
+bool covForm(CovRd* r, uint64_t form, const CovStrs* s, const char** str,
+             uint64_t* val) {
+  *str = NULL;
+  *val = 0;
+  switch (form) {
+    case 0x08:  // DW_FORM_string
+      *str = covStr(r->p, r->end);
+      r->p = *str ? r->p + strlen(*str) + 1 : r->end;
+      return true;
+    case 0x1f:  // DW_FORM_line_strp
+    case 0x0e: {  // DW_FORM_strp
+      uint32_t off = covU(r, 4);
+      const uint8_t* sec = form == 0x1f ? s->line_str : s->str;
+      uint32_t size = form == 0x1f ? s->line_str_size : s->str_size;
+      if (sec && off < size) *str = covStr(sec + off, sec + size);
+      return true;
+    }
+    case 0x0b: *val = covU(r, 1); return true;  // DW_FORM_data1
+    case 0x05: *val = covU(r, 2); return true;  // DW_FORM_data2
+    case 0x06: *val = covU(r, 4); return true;  // DW_FORM_data4
+    case 0x07: *val = covU(r, 8); return true;  // DW_FORM_data8
+    case 0x0f: *val = covUleb(r); return true;  // DW_FORM_udata
+    case 0x1e: covU(r, 8); covU(r, 8); return true;  // DW_FORM_data16
+    case 0x09: {  // DW_FORM_block
+      uint64_t n = covUleb(r);
+      r->p = n < (uint64_t)(r->end - r->p) ? r->p + n : r->end;
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+// Source files, shared by all compilation units.
+char* cov_files[COV_FILES];
+int cov_file_num = 0;
+
+// Global id of dir/name, or -1.
+int covFile(const char* dir, const char* name) {
+  if (!name) return -1;
+  char path[1024];
+  if (dir && name[0] != '/') snprintf(path, sizeof(path), "%s/%s", dir, name);
+  else snprintf(path, sizeof(path), "%s", name);
+  for (int i = 0; i < cov_file_num; ++i)
+    if (!strcmp(cov_files[i], path)) return i;
+  if (cov_file_num == COV_FILES) return -1;
+  cov_files[cov_file_num] = strdup(path);
+  return cov_file_num++;
+}
+
+// One instruction attributed to a source line.
+typedef struct {
+  int file;
+  uint32_t line, addr;
+} CovRow;
+
+CovRow* cov_rows = NULL;
+uint32_t cov_row_num = 0, cov_row_cap = 0;
+
+// Attribute the instructions in [lo, hi) to file:line.
+void covRange(int file, uint32_t line, uint32_t lo, uint32_t hi,
+              const uint8_t* mem) {
+  if (file < 0 || hi > cov_mem_size - 4 || lo >= hi) return;
+  bool branch;
+  for (uint32_t a = lo & ~1u; a < hi; a += covInst(mem, a, &branch)) {
+    if (cov_row_num == cov_row_cap) {
+      cov_row_cap = cov_row_cap ? 2 * cov_row_cap : 4096;
+      CovRow* rows = realloc(cov_rows, cov_row_cap * sizeof(CovRow));
+      if (!rows) return;
+      cov_rows = rows;
+    }
+    cov_rows[cov_row_num++] = (CovRow){file, line, a};
+  }
+}
+
+// Run the line-number program of every unit in .debug_line.
+void covLines(const uint8_t* sec, uint32_t size, const CovStrs* strs,
+              const uint8_t* mem) {
+  CovRd r = {sec, sec + size};
+  while (r.p + 4 <= r.end) {
+    uint32_t unit_len = covU(&r, 4);
+    if (unit_len >= 0xfffffff0 || unit_len > (uint32_t)(r.end - r.p)) break;
+    CovRd u = {r.p, r.p + unit_len};
+    r.p = u.end;
+    uint32_t ver = covU(&u, 2);
+    if (ver < 2 || ver > 5) continue;
+    if (ver >= 5) covU(&u, 2);  // address_size, segment_selector_size
+    uint32_t header_len = covU(&u, 4);
+    if (header_len > (uint32_t)(u.end - u.p)) continue;
+    const uint8_t* prog = u.p + header_len;
+    uint32_t min_len = covU(&u, 1);
+    if (ver >= 4) covU(&u, 1);  // maximum_operations_per_instruction
+    covU(&u, 1);  // default_is_stmt
+    int32_t line_base = (int8_t)covU(&u, 1);
+    uint32_t line_range = covU(&u, 1);
+    uint32_t opcode_base = covU(&u, 1);
+    if (!line_range || !opcode_base) continue;
+    uint8_t std_len[256] = {0};
+    for (uint32_t i = 1; i < opcode_base; ++i) std_len[i] = covU(&u, 1);
+
+    // Directory and file tables; files[] maps unit file numbers to ids.
+    const char* dirs[COV_DIRS] = {NULL};
+    int files[COV_DIRS];
+    uint32_t dir_num = 0, file_num = 0;
+    if (ver >= 5) {
+      for (int table = 0; table < 2; ++table) {
+        uint64_t fmt[16][2];
+        uint32_t fmt_num = covU(&u, 1);
+        if (fmt_num > 16) goto next_unit;
+        for (uint32_t i = 0; i < fmt_num; ++i) {
+          fmt[i][0] = covUleb(&u);
+          fmt[i][1] = covUleb(&u);
+        }
+        uint64_t n = covUleb(&u);
+        for (uint64_t e = 0; e < n; ++e) {
+          const char* path = NULL;
+          uint64_t dir = 0;
+          for (uint32_t i = 0; i < fmt_num; ++i) {
+            const char* str;
+            uint64_t val;
+            if (!covForm(&u, fmt[i][1], strs, &str, &val)) goto next_unit;
+            if (fmt[i][0] == 1) path = str;      // DW_LNCT_path
+            else if (fmt[i][0] == 2) dir = val;  // DW_LNCT_directory_index
+          }
+          if (table == 0 && dir_num < COV_DIRS) dirs[dir_num++] = path;
+          else if (table == 1 && file_num < COV_DIRS)
+            files[file_num++] = covFile(dir < dir_num ? dirs[dir] : NULL, path);
+        }
+      }
+    } else {
+      dirs[dir_num++] = NULL;  // 0: the compilation directory.
+      files[file_num++] = -1;  // Files count from 1.
+      const char* s;
+      while ((s = covStr(u.p, u.end)) && *s) {
+        if (dir_num < COV_DIRS) dirs[dir_num++] = s;
+        u.p += strlen(s) + 1;
+      }
+      ++u.p;
+      while ((s = covStr(u.p, u.end)) && *s) {
+        u.p += strlen(s) + 1;
+        uint64_t dir = covUleb(&u);
+        covUleb(&u);  // mtime
+        covUleb(&u);  // length
+        if (file_num < COV_DIRS)
+          files[file_num++] = covFile(dir < dir_num ? dirs[dir] : NULL, s);
+      }
+    }
+
+    // Line-number state machine. Each row covers up to the next one.
+    u.p = prog;
+    uint32_t addr = 0, file = 1, line = 1;
+    bool have_prev = false;
+    uint32_t prev_addr = 0, prev_file = 0, prev_line = 0;
+    while (u.p < u.end) {
+      uint32_t op = covU(&u, 1);
+      bool emit = false, end_seq = false;
+      if (op >= opcode_base) {  // Special opcode.
+        uint32_t adj = op - opcode_base;
+        addr += adj / line_range * min_len;
+        line += line_base + (int32_t)(adj % line_range);
+        emit = true;
+      } else if (op == 0) {  // Extended opcode.
+        uint64_t n = covUleb(&u);
+        if (!n || n > (uint64_t)(u.end - u.p)) break;
+        const uint8_t* next = u.p + n;
+        uint32_t sub = covU(&u, 1);
+        if (sub == 1) {  // DW_LNE_end_sequence
+          emit = end_seq = true;
+        } else if (sub == 2) {  // DW_LNE_set_address
+          addr = covU(&u, n - 1 >= 4 ? 4 : n - 1);
+        }
+        u.p = next;
+      } else {
+        switch (op) {
+          case 1: emit = true; break;  // DW_LNS_copy
+          case 2: addr += covUleb(&u) * min_len; break;
+          case 3: line += covSleb(&u); break;
+          case 4: file = covUleb(&u); break;
+          case 8: addr += (255 - opcode_base) / line_range * min_len; break;
+          case 9: addr += covU(&u, 2); break;
+          default:  // Column, flags, ISA: skip the operands.
+            for (uint32_t i = 0; i < std_len[op]; ++i) covUleb(&u);
+            break;
+        }
+      }
+      if (!emit) continue;
+      if (have_prev && addr > prev_addr)
+        covRange(prev_file < file_num ? files[prev_file] : -1, prev_line,
+                 prev_addr, addr, mem);
+      have_prev = !end_seq;
+      prev_addr = addr;
+      prev_file = file;
+      prev_line = line;
+      if (end_seq) addr = 0, file = 1, line = 1;
+    }
+  next_unit:;
+  }
+}
+
+int covRowCmp(const void* a, const void* b) {
+  const CovRow *x = a, *y = b;
+  if (x->file != y->file) return x->file - y->file;
+  if (x->line != y->line) return (x->line > y->line) - (x->line < y->line);
+  return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+// Write the lcov tracefile from the attributed instructions.
+void covLcov(const uint8_t* mem) {
+  FILE* f = fopen(COV_INFO, "w");
+  if (!f) return;
+  qsort(cov_rows, cov_row_num, sizeof(CovRow), covRowCmp);
+  for (uint32_t lo = 0, hi; lo < cov_row_num; lo = hi) {
+    int file = cov_rows[lo].file;
+    for (hi = lo; hi < cov_row_num && cov_rows[hi].file == file; ++hi) {}
+    fprintf(f, "TN:\nSF:%s\n", cov_files[file]);
+
+    // Functions start where a symbol does.
+    uint32_t fn = 0, fn_hit = 0;
+    for (uint32_t i = lo; i < hi; ++i) {
+      int s = symLookup(cov_rows[i].addr);
+      if (s == SYM_NONE || syms[s].addr != cov_rows[i].addr) continue;
+      fprintf(f, "FN:%u,%s\n", cov_rows[i].line, syms[s].name);
+    }
+    for (uint32_t i = lo; i < hi; ++i) {
+      int s = symLookup(cov_rows[i].addr);
+      if (s == SYM_NONE || syms[s].addr != cov_rows[i].addr) continue;
+      bool hit = COV_TEST(cov_exec, cov_rows[i].addr);
+      fprintf(f, "FNDA:%d,%s\n", hit, syms[s].name);
+      ++fn;
+      fn_hit += hit;
+    }
+    fprintf(f, "FNF:%u\nFNH:%u\n", fn, fn_hit);
+
+    // Two outcomes per conditional branch; "-" if its line never ran.
+    uint32_t br = 0, br_hit = 0, block = 0;
+    for (uint32_t i = lo; i < hi; ++i) {
+      uint32_t a = cov_rows[i].addr;
+      bool branch;
+      covInst(mem, a, &branch);
+      if (!branch) continue;
+      if (COV_TEST(cov_exec, a)) {
+        fprintf(f, "BRDA:%u,%u,0,%d\nBRDA:%u,%u,1,%d\n", cov_rows[i].line,
+                block, COV_TEST(cov_taken, a), cov_rows[i].line, block,
+                COV_TEST(cov_fall, a));
+        br_hit += COV_TEST(cov_taken, a) + COV_TEST(cov_fall, a);
+      } else {
+        fprintf(f, "BRDA:%u,%u,0,-\nBRDA:%u,%u,1,-\n", cov_rows[i].line,
+                block, cov_rows[i].line, block);
+      }
+      br += 2;
+      ++block;
+    }
+    fprintf(f, "BRF:%u\nBRH:%u\n", br, br_hit);
+
+    // A line ran if any of its instructions did.
+    uint32_t lines = 0, lines_hit = 0;
+    for (uint32_t i = lo, j; i < hi; i = j) {
+      bool hit = false;
+      for (j = i; j < hi && cov_rows[j].line == cov_rows[i].line; ++j)
+        hit |= COV_TEST(cov_exec, cov_rows[j].addr);
+      fprintf(f, "DA:%u,%d\n", cov_rows[i].line, hit);
+      ++lines;
+      lines_hit += hit;
+    }
+    fprintf(f, "LF:%u\nLH:%u\nend_of_record\n", lines, lines_hit);
+  }
+  fclose(f);
+  printf("Line coverage written to %s (%d source files)\n", COV_INFO,
+         cov_file_num);
+}
+
+int covFnCmp(const void* a, const void* b) {
+  const uint32_t *x = a, *y = b;
+  return (x[1] < y[1]) - (x[1] > y[1]);
+}
+
+void covDump(const uint8_t* elf, uint32_t len, const uint8_t* mem) {
+  if (!cov_exec) return;
+
+  // Totals over the executable sections.
+  CovCount total = {0};
+  const Elf32_Ehdr* elf_h = (const Elf32_Ehdr*)elf;
+  if (elf_h->e_shoff && elf_h->e_shentsize == sizeof(Elf32_Shdr) &&
+      elf_h->e_shoff + elf_h->e_shnum * sizeof(Elf32_Shdr) <= len) {
+    const Elf32_Shdr* sh = (const Elf32_Shdr*)(elf + elf_h->e_shoff);
+    for (int i = 0; i < elf_h->e_shnum; ++i)
+      if (sh[i].sh_flags & SHF_EXECINSTR)
+        covCount(mem, sh[i].sh_addr, sh[i].sh_addr + sh[i].sh_size, &total);
+  }
+  printf("\nCoverage\n");
+  printf("instructions %u/%u (%.1f%%), branch outcomes %u/%u (%.1f%%)\n",
+         total.hit, total.insts, covPct(total.hit, total.insts),
+         total.outcomes_hit, total.outcomes,
+         covPct(total.outcomes_hit, total.outcomes));
+
+  // Per function, most instructions missed first.
+  if (sym_num) {
+    uint32_t (*fn)[2] = malloc(sym_num * sizeof(*fn));  // Symbol, missed.
+    CovCount* counts = calloc(sym_num, sizeof(CovCount));
+    if (fn && counts) {
+      for (int i = 0; i < sym_num; ++i) {
+        uint32_t end = syms[i].size ? syms[i].addr + syms[i].size
+                       : i + 1 < sym_num ? syms[i + 1].addr
+                                         : syms[i].addr + 4;
+        covCount(mem, syms[i].addr, end, &counts[i]);
+        fn[i][0] = i;
+        fn[i][1] = counts[i].insts - counts[i].hit;
+      }
+      qsort(fn, sym_num, sizeof(*fn), covFnCmp);
+      printf("%-24s %13s %7s %13s %7s\n", "function", "instructions", "%",
+             "branches", "%");
+      for (int k = 0; k < sym_num && k < COV_TOP; ++k) {
+        const CovCount* c = &counts[fn[k][0]];
+        printf("%-24.24s %6u/%-6u %6.1f%% %6u/%-6u %6.1f%%\n",
+               syms[fn[k][0]].name, c->hit, c->insts, covPct(c->hit, c->insts),
+               c->outcomes_hit, c->outcomes,
+               covPct(c->outcomes_hit, c->outcomes));
+      }
+    }
+    free(fn);
+    free(counts);
+  }
+
+  // Source lines, if the ELF has DWARF line tables.
+  uint32_t size;
+  const uint8_t* lines = covSection(elf, len, ".debug_line", &size);
+  if (!lines) {
+    printf("No .debug_line: build the guest with -g for %s\n", COV_INFO);
+    return;
+  }
+  CovStrs strs = {0};
+  strs.line_str = covSection(elf, len, ".debug_line_str", &strs.line_str_size);
+  strs.str = covSection(elf, len, ".debug_str", &strs.str_size);
+  cov_row_num = 0;
+  covLines(lines, size, &strs, mem);
+  covLcov(mem);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Code coverage, enabled with -DCOVERAGE.
+// Records one bit per executed instruction address and, per conditional
+// branch, whether it was taken and whether it fell through. At exit, the ELF's
+// DWARF .debug_line (versions 2-5) maps addresses to source lines and an lcov
+// tracefile is written (genhtml, lcov --summary). A per-function table from
+// the symbol table is printed either way.
+
+#ifndef COV_INFO
+#define COV_INFO "coverage.info"  // lcov tracefile.
+#endif
+#ifndef COV_TOP
+#define COV_TOP 32  // Functions listed at exit.
+#endif
+
+extern uint8_t* cov_exec;
+extern uint8_t* cov_taken;
+extern uint8_t* cov_fall;
+
+#define COV_BIT(map, pc) ((map)[(pc) >> 4] |= 1 << (((pc) >> 1) & 7))
+#define COV_TEST(map, pc) (((map)[(pc) >> 4] >> (((pc) >> 1) & 7)) & 1)
+
+// Instruction at pc retired (pc is inside guest memory).
+#define COV_EXEC(pc) COV_BIT(cov_exec, pc)
+
+// Conditional branch at pc resolved.
+#define COV_BRANCH(pc, taken) COV_BIT((taken) ? cov_taken : cov_fall, pc)
+
+// Clear the bitmaps for mem_size bytes of guest memory.
+void covReset(uint32_t mem_size);
+
+// Print the function table and write the lcov file. elf is the loaded
+// image, mem the guest memory holding its code.
+void covDump(const uint8_t* elf, uint32_t len, const uint8_t* mem);
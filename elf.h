@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+// ELF header.
+#define ELFMAG_W0 0x464C457F /* 7F E L F */
+#define ELFMAG_W4 0x00010101 /* 32-bit, LSB, SysV ABI */
+#define ET_EXEC 2            /* Executable file */
+#define EM_RISCV 243         /* RISC-V */
+typedef struct {
+  uint8_t e_ident[16]; /* Magic number and other info */
+  uint16_t e_type;     /* Object file type */
+  uint16_t e_machine;  /* Architecture */
+  uint32_t e_version;  /* Object file version */
+  uint32_t e_entry;    /* Entry point virtual address */
+  uint32_t e_phoff;    /* Program header table file offset */
+  uint32_t e_shoff;    /* Section header table file offset */
+  uint32_t e_flags;    /* Processor-specific flags */
+  uint16_t e_ehsize;   /* ELF header size in bytes */
+  uint16_t e_phentsize;/* Program header table entry size */
+  uint16_t e_phnum;    /* Program header table entry count */
+  uint16_t e_shentsize;/* Section header table entry size */
+  uint16_t e_shnum;    /* Section header table entry count */
+  uint16_t e_shstrndx; /* Section header string table index */
+} Elf32_Ehdr;
+
+// Program header.
+#define PT_LOAD 1            /* Loadable segment */
+typedef struct {
+  uint32_t p_type;   /* Segment type */
+  uint32_t p_offset; /* Segment file offset */
+  uint32_t p_vaddr;  /* Segment virtual address */
+  uint32_t p_paddr;  /* Segment physical address */
+  uint32_t p_filesz; /* Segment size in file */
+  uint32_t p_memsz;  /* Segment size in memory */
+  uint32_t p_flags;  /* Segment flags */
+  uint32_t p_align;  /* Segment alignment */
+} Elf32_Phdr;
+
+// Section header.
+#define SHT_SYMTAB 2         /* Symbol table */
+#define SHF_EXECINSTR 0x4    /* Executable */
+typedef struct {
+  uint32_t sh_name;      /* Section name (string tbl index) */
+  uint32_t sh_type;      /* Section type */
+  uint32_t sh_flags;     /* Section flags */
+  uint32_t sh_addr;      /* Section virtual addr at execution */
+  uint32_t sh_offset;    /* Section file offset */
+  uint32_t sh_size;      /* Section size in bytes */
+  uint32_t sh_link;      /* Link to another section */
+  uint32_t sh_info;      /* Additional section information */
+  uint32_t sh_addralign; /* Section alignment */
+  uint32_t sh_entsize;   /* Entry size if section holds table */
+} Elf32_Shdr;
+
+// Symbol table entry.
+#define STT_NOTYPE 0         /* Symbol type is unspecified */
+#define STT_FUNC 2           /* Symbol is a code object */
+#define ELF32_ST_TYPE(info) ((info) & 0xf)
+typedef struct {
+  uint32_t st_name;  /* Symbol name (string tbl index) */
+  uint32_t st_value; /* Symbol value */
+  uint32_t st_size;  /* Symbol size */
+  uint8_t st_info;   /* Symbol type and binding */
+  uint8_t st_other;  /* Symbol visibility */
+  uint16_t st_shndx; /* Section index */
+} Elf32_Sym;
@@ -0,0 +1,352 @@
+#include "fpu.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef __NIOS2__
+#include <fenv.h>
+#endif
+
+uint64_t freg[32];
+uint32_t fcsr = 0;
+
+#define FIELD(x, hi, lo) (((x) >> (lo)) & ((1u << ((hi) - (lo) + 1)) - 1))
+
+// fflags bits.
+#define FF_NV 0x10  // Invalid operation.
+#define FF_DZ 0x08  // Divide by zero.
+#define FF_OF 0x04  // Overflow.
+#define FF_UF 0x02  // Underflow.
+#define FF_NX 0x01  // Inexact.
+
+#define CANON_S 0x7FC00000u
+#define CANON_D 0x7FF8000000000000ull
+#define NAN_BOX 0xFFFFFFFF00000000ull
+
+// fclass result bits used for NaN checks.
+#define CLASS_SNAN 0x100
+#define CLASS_NAN  0x300
+
+enum RoundingMode { RM_RNE, RM_RTZ, RM_RDN, RM_RUP, RM_RMM, RM_DYN = 7 };
+
+#ifndef __NIOS2__
+// Host modes by RISC-V rm. The host has no ties-to-max-magnitude mode, so
+// RMM arithmetic rounds ties to even; conversions to integer honor RMM.
+const int fe_modes[5] = {FE_TONEAREST, FE_TOWARDZERO, FE_DOWNWARD, FE_UPWARD,
+                         FE_TONEAREST};
+int host_round = FE_TONEAREST;
+#endif
+
+void fpuReset() {
+  memset(freg, 0, sizeof(freg));
+  fcsr = 0;
+}
+
+bool fpuCsrRead(uint32_t csr, uint32_t *val) {
+  switch (csr) {
+    case CSR_FFLAGS: *val = fcsr & 0x1F; break;
+    case CSR_FRM:    *val = (fcsr >> 5) & 0b111; break;
+    case CSR_FCSR:   *val = fcsr & 0xFF; break;
+    default: return false;
+  }
+  return true;
+}
+
+bool fpuCsrWrite(uint32_t csr, uint32_t val) {
+  switch (csr) {
+    case CSR_FFLAGS: fcsr = (fcsr & ~0x1Fu) | (val & 0x1F); break;
+    case CSR_FRM:    fcsr = (fcsr & 0x1F) | (val & 0b111) << 5; break;
+    case CSR_FCSR:   fcsr = val & 0xFF; break;
+    default: return false;
+  }
+  return true;
+}
+
+// Effective rounding mode of an instruction's rm field, or -1 if reserved.
+int fpuRm(uint32_t rm) {
+  if (rm == RM_DYN) rm = (fcsr >> 5) & 0b111;
+  return rm <= RM_RMM ? (int)rm : -1;
+}
+
+// Set the host rounding mode and clear host exception flags before an op.
+void fpuBegin(int rm) {
+#ifndef __NIOS2__
+  if (fe_modes[rm] != host_round) fesetround(host_round = fe_modes[rm]);
+  feclearexcept(FE_ALL_EXCEPT);
+#else
+  (void)rm;
+#endif
+}
+
+// Accrue host exception flags raised since fpuBegin into fflags.
+void fpuEnd() {
+#ifndef __NIOS2__
+  int ex = fetestexcept(FE_ALL_EXCEPT);
+  if (ex & FE_INVALID) fcsr |= FF_NV;
+  if (ex & FE_DIVBYZERO) fcsr |= FF_DZ;
+  if (ex & FE_OVERFLOW) fcsr |= FF_OF;
+  if (ex & FE_UNDERFLOW) fcsr |= FF_UF;
+  if (ex & FE_INEXACT) fcsr |= FF_NX;
+#endif
+}
+
+// Register bits in the operand format. A single that is not NaN-boxed reads
+// as the canonical NaN.
+uint64_t fpuBits(uint32_t r, bool dbl) {
+  if (dbl) return freg[r];
+  return (freg[r] >> 32) == 0xFFFFFFFF ? (uint32_t)freg[r] : CANON_S;
+}
+
+// Singles widen to double exactly, so both formats compute in double.
+double fpuBitsVal(uint64_t bits, bool dbl) {
+  if (dbl) {
+    double d;
+    memcpy(&d, &bits, 8);
+    return d;
+  }
+  uint32_t s = bits;
+  float f;
+  memcpy(&f, &s, 4);
+  return f;
+}
+
+double fpuVal(uint32_t r, bool dbl) {
+  return fpuBitsVal(fpuBits(r, dbl), dbl);
+}
+
+void fpuSetBits(uint32_t r, uint64_t bits, bool dbl) {
+  freg[r] = dbl ? bits : NAN_BOX | (uint32_t)bits;
+}
+
+// Write an arithmetic result: singles round once from the double result
+// (exact for + - * / sqrt, since double has more than 2*24+2 bits), and NaNs
+// become the canonical NaN.
+void fpuSetVal(uint32_t r, double v, bool dbl) {
+  if (dbl) {
+    uint64_t b = CANON_D;
+    if (!isnan(v)) memcpy(&b, &v, 8);
+    freg[r] = b;
+  } else {
+    float f = (float)v;
+    uint32_t b = CANON_S;
+    if (!isnan(f)) memcpy(&b, &f, 4);
+    freg[r] = NAN_BOX | b;
+  }
+}
+
+uint32_t fpuClass(uint64_t bits, bool dbl) {
+  uint32_t mbits = dbl ? 52 : 23, ebits = dbl ? 11 : 8;
+  bool sign = (bits >> (mbits + ebits)) & 1;
+  uint32_t exp = (bits >> mbits) & ((1u << ebits) - 1);
+  uint64_t man = bits & ((1ull << mbits) - 1);
+  if (exp == (1u << ebits) - 1) {
+    if (man == 0) return sign ? 1 << 0 : 1 << 7;  // -inf / +inf
+    return (man >> (mbits - 1)) ? 1 << 9 : 1 << 8;  // qNaN / sNaN
+  }
+  if (exp == 0) {
+    if (man == 0) return sign ? 1 << 3 : 1 << 4;  // -0 / +0
+    return sign ? 1 << 2 : 1 << 5;                // subnormal
+  }
+  return sign ? 1 << 1 : 1 << 6;                  // normal
+}
+
+// FCVT.W[U]: round by rm, saturate out-of-range and NaN inputs with NV.
+uint32_t fpuToInt(double v, int rm, bool is_unsigned) {
+  if (isnan(v)) {
+    fcsr |= FF_NV;
+    return is_unsigned ? UINT32_MAX : INT32_MAX;
+  }
+  double r;
+  switch (rm) {
+    case RM_RTZ: r = trunc(v); break;
+    case RM_RDN: r = floor(v); break;
+    case RM_RUP: r = ceil(v); break;
+    case RM_RMM: r = round(v); break;
+    default:     r = nearbyint(v); break;  // Host mode is ties-to-even.
+  }
+  if (is_unsigned ? r < 0 : r < -2147483648.0) {
+    fcsr |= FF_NV;
+    return is_unsigned ? 0 : (uint32_t)INT32_MIN;
+  }
+  if (is_unsigned ? r > 4294967295.0 : r > 2147483647.0) {
+    fcsr |= FF_NV;
+    return is_unsigned ? UINT32_MAX : INT32_MAX;
+  }
+  if (r != v) fcsr |= FF_NX;
+  return is_unsigned ? (uint32_t)r : (uint32_t)(int32_t)r;
+}
+
+enum FpMemStatus fpuLoadStore(uint32_t inst, uint32_t *x, uint8_t *mem,
+                              uint32_t mem_size, uint32_t *fault,
+                              char *out_op) {
+  bool store = FIELD(inst, 5, 5);
+  uint32_t funct3 = FIELD(inst, 14, 12), rs1 = FIELD(inst, 19, 15);
+  if (funct3 != 0b010 && funct3 != 0b011) {
+    sprintf(out_op, "unknown fp %s", store ? "store" : "load");
+    return FP_MEM_ILLEGAL;
+  }
+  bool dbl = funct3 == 0b011;
+  uint32_t size = dbl ? 8 : 4;
+  uint32_t fr = store ? FIELD(inst, 24, 20) : FIELD(inst, 11, 7);
+  int32_t imm = store ? (int32_t)(FIELD(inst, 31, 25) << 25 | FIELD(inst, 11, 7) << 20) >> 20
+                      : (int32_t)inst >> 20;
+  uint32_t addr = x[rs1] + imm;
+  sprintf(out_op, "f%s%c f%d, %d(x%d)", store ? "s" : "l", dbl ? 'd' : 'w', fr,
+          imm, rs1);
+  if (addr > mem_size - size) {
+    *fault = addr;
+    return FP_MEM_FAULT;
+  }
+  if (store) {
+    memcpy(&mem[addr], &freg[fr], size);  // FSW stores the low word as is.
+  } else if (dbl) {
+    memcpy(&freg[fr], &mem[addr], 8);
+  } else {
+    uint32_t w;
+    memcpy(&w, &mem[addr], 4);
+    freg[fr] = NAN_BOX | w;
+  }
+  return FP_MEM_OK;
+}
+
+bool fpuOp(uint32_t inst, uint32_t *x, char *out_op) {
+  uint32_t opcode = FIELD(inst, 6, 0), rd = FIELD(inst, 11, 7);
+  uint32_t funct3 = FIELD(inst, 14, 12), rs1 = FIELD(inst, 19, 15);
+  uint32_t rs2 = FIELD(inst, 24, 20), fmt = FIELD(inst, 26, 25);
+  uint32_t funct5 = FIELD(inst, 31, 27);  // rs3 for the fused ops
+  bool dbl = fmt == 0b01;
+  char f = dbl ? 'd' : 's';
+  int rm = fpuRm(funct3);
+  if (fmt > 0b01) goto unknown;
+
+  if (opcode != OP_FP) {  // FMADD / FMSUB / FNMSUB / FNMADD
+    static const char *fma_ops[4] = {"fmadd", "fmsub", "fnmsub", "fnmadd"};
+    uint32_t op = (opcode >> 2) & 0b11;
+    if (rm < 0) goto unknown;
+    fpuBegin(rm);
+    double a = fpuVal(rs1, dbl), b = fpuVal(rs2, dbl), c = fpuVal(funct5, dbl);
+    if (op & 1) c = -c;  // FMSUB, FNMADD
+    if (op & 2) a = -a;  // FNMSUB, FNMADD
+    fpuSetVal(rd, dbl ? fma(a, b, c) : fmaf(a, b, c), dbl);
+    fpuEnd();
+    sprintf(out_op, "%s.%c f%d, f%d, f%d, f%d", fma_ops[op], f, rd, rs1, rs2,
+            funct5);
+    return true;
+  }
+
+  switch (funct5) {
+    case 0b00000:  // FADD
+    case 0b00001:  // FSUB
+    case 0b00010:  // FMUL
+    case 0b00011:  // FDIV
+    case 0b01011: {  // FSQRT
+      static const char *arith_ops[4] = {"fadd", "fsub", "fmul", "fdiv"};
+      if (rm < 0 || (funct5 == 0b01011 && rs2 != 0)) goto unknown;
+      fpuBegin(rm);
+      double a = fpuVal(rs1, dbl), b = fpuVal(rs2, dbl), r;
+      switch (funct5) {
+        case 0b00000: r = a + b; break;
+        case 0b00001: r = a - b; break;
+        case 0b00010: r = a * b; break;
+        case 0b00011: r = a / b; break;
+        default:      r = sqrt(a); break;
+      }
+      fpuSetVal(rd, r, dbl);
+      fpuEnd();
+      if (funct5 == 0b01011)
+        sprintf(out_op, "fsqrt.%c f%d, f%d", f, rd, rs1);
+      else
+        sprintf(out_op, "%s.%c f%d, f%d, f%d", arith_ops[funct5], f, rd, rs1, rs2);
+      return true;
+    }
+    case 0b00100: {  // FSGNJ / FSGNJN / FSGNJX
+      static const char *sgnj_ops[3] = {"fsgnj", "fsgnjn", "fsgnjx"};
+      uint64_t a = fpuBits(rs1, dbl), b = fpuBits(rs2, dbl);
+      uint64_t sign = 1ull << (dbl ? 63 : 31);
+      if (funct3 > 0b010) goto unknown;
+      if (funct3 == 0b000) a = (a & ~sign) | (b & sign);
+      else if (funct3 == 0b001) a = (a & ~sign) | (~b & sign);
+      else a ^= b & sign;
+      fpuSetBits(rd, a, dbl);
+      sprintf(out_op, "%s.%c f%d, f%d, f%d", sgnj_ops[funct3], f, rd, rs1, rs2);
+      return true;
+    }
+    case 0b00101: {  // FMIN / FMAX: NaN only if both are; -0 < +0.
+      uint64_t a = fpuBits(rs1, dbl), b = fpuBits(rs2, dbl), r;
+      uint32_t ca = fpuClass(a, dbl), cb = fpuClass(b, dbl);
+      bool is_min = funct3 == 0b000;
+      if (funct3 > 0b001) goto unknown;
+      if ((ca | cb) & CLASS_SNAN) fcsr |= FF_NV;
+      if ((ca & CLASS_NAN) && (cb & CLASS_NAN)) r = dbl ? CANON_D : CANON_S;
+      else if (ca & CLASS_NAN) r = b;
+      else if (cb & CLASS_NAN) r = a;
+      else {
+        double va = fpuBitsVal(a, dbl), vb = fpuBitsVal(b, dbl);
+        if (va == vb) r = (signbit(va) != 0) == is_min ? a : b;
+        else r = (va < vb) == is_min ? a : b;
+      }
+      fpuSetBits(rd, r, dbl);
+      sprintf(out_op, "%s.%c f%d, f%d, f%d", is_min ? "fmin" : "fmax", f, rd,
+              rs1, rs2);
+      return true;
+    }
+    case 0b01000:  // FCVT.S.D (fmt S, rs2 = 1) / FCVT.D.S (fmt D, rs2 = 0)
+      if (rm < 0 || rs2 != (dbl ? 0u : 1u)) goto unknown;
+      fpuBegin(rm);
+      fpuSetVal(rd, fpuVal(rs1, !dbl), dbl);
+      fpuEnd();
+      sprintf(out_op, "fcvt.%c.%c f%d, f%d", f, dbl ? 's' : 'd', rd, rs1);
+      return true;
+    case 0b10100: {  // FLE / FLT / FEQ
+      static const char *cmp_ops[3] = {"fle", "flt", "feq"};
+      uint64_t a = fpuBits(rs1, dbl), b = fpuBits(rs2, dbl);
+      uint32_t cls = fpuClass(a, dbl) | fpuClass(b, dbl);
+      if (funct3 > 0b010) goto unknown;
+      // FEQ is quiet (NV on sNaN only), FLT/FLE signal on any NaN.
+      if (cls & (funct3 == 0b010 ? CLASS_SNAN : CLASS_NAN)) fcsr |= FF_NV;
+      double va = fpuBitsVal(a, dbl), vb = fpuBitsVal(b, dbl);
+      uint32_t res = 0;
+      if (!(cls & CLASS_NAN)) {
+        if (funct3 == 0b000) res = va <= vb;
+        else if (funct3 == 0b001) res = va < vb;
+        else res = va == vb;
+      }
+      x[rd] = res;
+      sprintf(out_op, "%s.%c x%d, f%d, f%d", cmp_ops[funct3], f, rd, rs1, rs2);
+      return true;
+    }
+    case 0b11000:  // FCVT.W / FCVT.WU
+      if (rm < 0 || rs2 > 1) goto unknown;
+      fpuBegin(rm);
+      x[rd] = fpuToInt(fpuVal(rs1, dbl), rm, rs2);
+      sprintf(out_op, "fcvt.w%s.%c x%d, f%d", rs2 ? "u" : "", f, rd, rs1);
+      return true;
+    case 0b11010:  // FCVT.S/D.W / FCVT.S/D.WU
+      if (rm < 0 || rs2 > 1) goto unknown;
+      fpuBegin(rm);
+      fpuSetVal(rd, rs2 ? (double)x[rs1] : (double)(int32_t)x[rs1], dbl);
+      fpuEnd();
+      sprintf(out_op, "fcvt.%c.w%s f%d, x%d", f, rs2 ? "u" : "", rd, rs1);
+      return true;
+    case 0b11100:  // FMV.X.W / FCLASS
+      if (rs2 != 0) goto unknown;
+      if (funct3 == 0b000 && !dbl) {
+        x[rd] = (uint32_t)freg[rs1];
+        sprintf(out_op, "fmv.x.w x%d, f%d", rd, rs1);
+      } else if (funct3 == 0b001) {
+        x[rd] = fpuClass(fpuBits(rs1, dbl), dbl);
+        sprintf(out_op, "fclass.%c x%d, f%d", f, rd, rs1);
+      } else {
+        goto unknown;
+      }
+      return true;
+    case 0b11110:  // FMV.W.X
+      if (rs2 != 0 || funct3 != 0 || dbl) goto unknown;
+      freg[rd] = NAN_BOX | x[rs1];
+      sprintf(out_op, "fmv.w.x f%d, x%d", rd, rs1);
+      return true;
+  }
+unknown:
+  sprintf(out_op, "unknown op-fp");
+  return false;
+}
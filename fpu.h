@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// RV32F/D: 64-bit floating-point registers (singles NaN-boxed), fcsr with
+// rounding mode and accrued exception flags, computed on the host FPU.
+
+// Major opcodes; FP loads/stores share LOAD-FP/STORE-FP with vectors.
+#define OP_FP     0b1010011
+#define OP_FMADD  0b1000011
+#define OP_FMSUB  0b1000111
+#define OP_FNMSUB 0b1001011
+#define OP_FNMADD 0b1001111
+
+// FP CSRs.
+enum FpuCsrAddr {
+  CSR_FFLAGS = 0x001,
+  CSR_FRM    = 0x002,
+  CSR_FCSR   = 0x003,
+};
+
+extern uint64_t freg[32];
+extern uint32_t fcsr;  // frm in [7:5], fflags (NV DZ OF UF NX) in [4:0].
+
+void fpuReset();
+
+bool fpuCsrRead(uint32_t csr, uint32_t *val);
+bool fpuCsrWrite(uint32_t csr, uint32_t val);
+
+// Outcome of a LOAD-FP/STORE-FP access, scalar or vector.
+enum FpMemStatus { FP_MEM_OK, FP_MEM_FAULT, FP_MEM_ILLEGAL };
+
+// FLW/FLD/FSW/FSD. x is the scalar register file. Returns FP_MEM_FAULT on an
+// out-of-bounds access, with the faulting address in fault, and
+// FP_MEM_ILLEGAL for other widths.
+enum FpMemStatus fpuLoadStore(uint32_t inst, uint32_t *x, uint8_t *mem,
+                              uint32_t mem_size, uint32_t *fault,
+                              char *out_op);
+
+// OP-FP and the fused multiply-add opcodes. x is the scalar register file.
+// Returns false, without side effects, for encodings outside RV32FD.
+bool fpuOp(uint32_t inst, uint32_t *x, char *out_op);
@@ -0,0 +1,110 @@
+#include "fuzz.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define FORKSRV_FD 198  // AFL control pipe; status pipe is FORKSRV_FD + 1.
+
+uint8_t fuzz_local_map[FUZZ_MAP_SIZE];
+uint8_t *fuzz_map = fuzz_local_map;
+uint32_t fuzz_prev = 0;
+bool fuzz_started = false;
+bool fuzz_afl = false;  // Running under afl-fuzz.
+uint32_t fuzz_runs = 0;  // Inputs run by this process.
+
+uint8_t fuzz_input[FUZZ_INPUT_MAX];
+uint32_t fuzz_len = 0, fuzz_pos = 0;
+
+// Read the current input from stdin, which AFL rewrites for every run.
+void fuzzRead() {
+  lseek(0, 0, SEEK_SET);
+  fuzz_len = fuzz_pos = 0;
+  ssize_t n;
+  while (fuzz_len < FUZZ_INPUT_MAX &&
+         (n = read(0, fuzz_input + fuzz_len, FUZZ_INPUT_MAX - fuzz_len)) > 0)
+    fuzz_len += n;
+  fuzz_prev = 0;
+}
+
+// AFL fork server loop, as in afl-llvm-rt: fork (or resume a stopped
+// persistent child) per request, report its pid and wait status.
+void fuzzServe() {
+  pid_t child = -1;
+  bool stopped = false;
+  while (true) {
+    uint32_t was_killed;
+    int status;
+    if (read(FORKSRV_FD, &was_killed, 4) != 4) _exit(0);
+    // AFL killed the stopped child after a timeout: reap it, fork afresh.
+    if (stopped && was_killed) {
+      stopped = false;
+      if (waitpid(child, &status, 0) < 0) _exit(1);
+    }
+    if (stopped) {
+      kill(child, SIGCONT);
+      stopped = false;
+    } else {
+      child = fork();
+      if (child < 0) _exit(1);
+      if (!child) {
+        close(FORKSRV_FD);
+        close(FORKSRV_FD + 1);
+        return;
+      }
+    }
+    if (write(FORKSRV_FD + 1, &child, 4) != 4) _exit(1);
+    if (waitpid(child, &status, FUZZ_PERSIST ? WUNTRACED : 0) < 0) _exit(1);
+    if (WIFSTOPPED(status)) stopped = true;
+    if (write(FORKSRV_FD + 1, &status, 4) != 4) _exit(1);
+  }
+}
+
+void fuzzStart() {
+  fuzz_started = true;
+  const char *shm_id = getenv("__AFL_SHM_ID");
+  if (shm_id) {
+    void *map = shmat(atoi(shm_id), NULL, 0);
+    if (map != (void *)-1) fuzz_map = map;
+  }
+  fflush(stdout);  // Children must not repeat the warm-up output.
+  uint32_t hello = 0;
+  fuzz_afl = shm_id && write(FORKSRV_FD + 1, &hello, 4) == 4;
+  if (fuzz_afl) fuzzServe();
+  fuzzRead();
+}
+
+int32_t fuzzByte() {
+  return fuzz_pos < fuzz_len ? fuzz_input[fuzz_pos++] : -1;
+}
+
+bool fuzzEnd(bool crash) {
+  if (!fuzz_started) return false;
+  if (crash) abort();
+#if FUZZ_PERSIST
+  if (fuzz_afl && ++fuzz_runs < FUZZ_PERSIST) {
+    raise(SIGSTOP);  // Done: the fork server resumes us for the next input.
+    fuzzRead();
+    return true;
+  }
+#endif
+  return false;
+}
+
+bool fuzzPersisting() {
+#if FUZZ_PERSIST
+  return fuzz_started && fuzz_afl && fuzz_runs + 1 < FUZZ_PERSIST;
+#else
+  return false;
+#endif
+}
+
+void fuzzDump() {
+  if (fuzz_afl) return;
+  uint32_t edges = 0;
+  for (uint32_t i = 0; i < FUZZ_MAP_SIZE; ++i) edges += fuzz_map[i] != 0;
+  printf("fuzz: %u input bytes, %u edges\n", fuzz_len, edges);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fuzzing front end, enabled with -DFUZZ (implies -DBATCH).
+// The guest runs once up to its first input read (ecall 200), which then
+// returns the next input byte, or -1 past the end. From that point:
+// - under afl-fuzz, the emulator becomes an AFL fork server and each input
+//   runs in a fresh fork of the warmed-up process;
+// - with -DFUZZ_PERSIST=N, each forked child runs up to N inputs, restoring
+//   the pre-input guest state in process between them (AFL persistent mode);
+// - outside afl-fuzz, the input on stdin runs once (crash reproduction).
+// Branches, JAL and JALR update an AFL-compatible edge bitmap. A guest fault
+// aborts the emulator, which AFL records as a crash.
+
+#ifndef FUZZ_PERSIST
+#define FUZZ_PERSIST 0  // Inputs per forked child; 0 forks for every input.
+#endif
+#define FUZZ_MAP_SIZE 65536  // AFL's default MAP_SIZE.
+#ifndef FUZZ_INPUT_MAX
+#define FUZZ_INPUT_MAX (1 << 20)
+#endif
+
+extern uint8_t *fuzz_map;
+extern uint32_t fuzz_prev;
+extern bool fuzz_started;
+
+// Control reached pc: count the edge from the previous location.
+#define FUZZ_EDGE(pc)                                   \
+  {                                                     \
+    uint32_t fuzz_cur = ((pc) * 0x9E3779B1u) >> 16;     \
+    ++fuzz_map[fuzz_cur ^ fuzz_prev];                   \
+    fuzz_prev = fuzz_cur >> 1;                          \
+  }
+
+// First input read: attach AFL's bitmap, run the fork server, read the
+// input. Returns in each child.
+void fuzzStart();
+
+// Next input byte, or -1 past the end.
+int32_t fuzzByte();
+
+// The guest finished the current input, crash if it faulted. Returns true
+// if another input follows in this process: the caller restores the state
+// saved before fuzzStart and resumes the guest.
+bool fuzzEnd(bool crash);
+
+// True while the current input is not the last this process runs; its exit
+// report is skipped.
+bool fuzzPersisting();
+
+// Print the edges hit (outside afl-fuzz).
+void fuzzDump();
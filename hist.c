@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hist.h"
+
+// Open-addressing table of mnemonics; an empty name marks a free slot.
+char mnemonic_names[MNEMONIC_MAX][HIST_NAME_W];
+
+uint64_t hist_count[MNEMONIC_MAX];
+uint64_t hist_other = 0;  // Illegal or faulting, or no free slot.
+int hist_order[MNEMONIC_MAX];  // Dump order; the table stays hashed.
+
+void histReset() {
+  memset(hist_count, 0, sizeof(hist_count));
+  hist_other = 0;
+}
+
+int mnemonicId(const char* op) {
+  uint32_t h = 2166136261u;  // FNV-1a.
+  int len = 0;
+  while (op[len] && op[len] != ' ' && len < HIST_NAME_W - 1) {
+    h = (h ^ (uint8_t)op[len]) * 16777619u;
+    ++len;
+  }
+  if (len == 0) return -1;
+  uint32_t i = h & (MNEMONIC_MAX - 1);
+  for (int probe = 0; probe < MNEMONIC_MAX; ++probe, i = (i + 1) & (MNEMONIC_MAX - 1)) {
+    char* name = mnemonic_names[i];
+    if (name[0] == '\0') {  // New mnemonic.
+      memcpy(name, op, len);
+      name[len] = '\0';
+    } else if (strncmp(name, op, len) || name[len] != '\0') {
+      continue;  // Collision.
+    }
+    return i;
+  }
+  return -1;  // Table full.
+}
+
+const char* mnemonicName(int id) { return mnemonic_names[id]; }
+
+void histCount(const char* op) {
+  int id = op ? mnemonicId(op) : -1;
+  if (id < 0) ++hist_other;
+  else ++hist_count[id];
+}
+
+int histCmp(const void* a, const void* b) {
+  uint64_t ca = hist_count[*(const int*)a], cb = hist_count[*(const int*)b];
+  return (ca < cb) - (ca > cb);  // Descending.
+}
+
+void histDump(uint64_t instret) {
+  int n = 0;
+  for (int i = 0; i < MNEMONIC_MAX; ++i) {
+    if (hist_count[i]) hist_order[n++] = i;
+  }
+  qsort(hist_order, n, sizeof(int), histCmp);
+
+  printf("\nInstruction histogram (%llu retired)\n", (unsigned long long)instret);
+  for (int i = 0; i < n; ++i) {
+    uint64_t count = hist_count[hist_order[i]];
+    printf("%-12s %12llu  %6.2f%%\n", mnemonic_names[hist_order[i]],
+           (unsigned long long)count, instret ? 100.0 * count / instret : 0.0);
+  }
+  if (hist_other) {
+    printf("%-12s %12llu  %6.2f%%\n", "(other)", (unsigned long long)hist_other,
+           instret ? 100.0 * hist_other / instret : 0.0);
+  }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+// Per-mnemonic histogram of executed instructions.
+// Enable with -DINST_HIST; dumped to the terminal at exit.
+
+#define HIST_NAME_W 16  // Longest mnemonic kept, including the terminator.
+#define MNEMONIC_MAX 256  // Distinct mnemonics tracked, power of two.
+
+// Id in [0, MNEMONIC_MAX) of the mnemonic (first word) of a disassembly
+// string, added on first use, or -1 once the table is full. Shared with
+// hostperf, so ids stay valid across resets.
+int mnemonicId(const char* op);
+
+// Mnemonic for an id from mnemonicId.
+const char* mnemonicName(int id);
+
+void histReset();
+
+// Count one instruction, keyed by the first word of its disassembly. NULL
+// (an illegal or faulting instruction) counts as (other).
+void histCount(const char* op);
+
+void histDump(uint64_t instret);
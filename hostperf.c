@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__) && !defined(__NIOS2__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HOSTPERF_AVAILABLE
+#endif
+
+#include "hist.h"
+#include "hostperf.h"
+#include "sym.h"
+
+#define HOSTPERF_PCS 4096  // Pc table, power of two.
+
+typedef struct {  // Indexed by mnemonicId.
+  uint64_t count;
+  uint64_t ctr[HP_NUM];
+} HostPerfOp;
+
+typedef struct {
+  uint32_t pc;  // 0 marks an empty slot; the guest never executes at 0.
+  uint64_t count;
+  uint64_t ctr[HP_NUM];
+} HostPerfPc;
+
+HostPerfOp hostperf_ops[MNEMONIC_MAX];
+HostPerfPc hostperf_pcs[HOSTPERF_PCS];
+int hostperf_pc_num = 0;
+uint64_t hostperf_lost = 0;  // Pcs dropped when the table is full.
+uint32_t hostperf_countdown = HOSTPERF_EVERY;
+uint64_t hostperf_start[HP_NUM];
+uint64_t hostperf_overhead[HP_NUM];  // Cost of an empty measured region.
+int hostperf_fd = -1;  // Group leader, -1 if counters are unavailable.
+
+const char* hostperf_names[HP_NUM] = {
+  "cycles", "instructions", "cache-misses", "branch-misses"};
+
+#ifdef HOSTPERF_AVAILABLE
+const uint64_t hostperf_config[HP_NUM] = {
+  PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+int hostperfOpen() {
+  int fds[HP_NUM];
+  int leader = -1;
+  for (int i = 0; i < HP_NUM; ++i) {
+    struct perf_event_attr pe;
+    memset(&pe, 0, sizeof(pe));
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.size = sizeof(pe);
+    pe.config = hostperf_config[i];
+    pe.disabled = leader == -1;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    pe.read_format = PERF_FORMAT_GROUP;
+    fds[i] = syscall(SYS_perf_event_open, &pe, 0, -1, leader, 0);
+    if (fds[i] == -1) {
+      while (i-- > 0) close(fds[i]);
+      return -1;
+    }
+    if (leader == -1) leader = fds[i];
+  }
+  ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return leader;
+}
+#endif
+
+void hostperfRead(uint64_t* out) {
+#ifdef HOSTPERF_AVAILABLE
+  uint64_t buf[1 + HP_NUM];
+  if (read(hostperf_fd, buf, sizeof(buf)) == sizeof(buf)) {
+    memcpy(out, buf + 1, sizeof(uint64_t) * HP_NUM);
+    return;
+  }
+#endif
+  memset(out, 0, sizeof(uint64_t) * HP_NUM);
+}
+
+void hostperfReset() {
+  memset(hostperf_ops, 0, sizeof(hostperf_ops));
+  memset(hostperf_pcs, 0, sizeof(hostperf_pcs));
+  hostperf_pc_num = 0;
+  hostperf_lost = 0;
+  hostperf_countdown = HOSTPERF_EVERY;
+#ifdef HOSTPERF_AVAILABLE
+  if (hostperf_fd == -1) hostperf_fd = hostperfOpen();
+#endif
+  if (hostperf_fd == -1) {
+    printf("hostperf: perf_event_open unavailable, counters disabled\n");
+    return;
+  }
+
+  // Calibrate: the smallest reading of an empty region is pure overhead.
+  uint64_t a[HP_NUM], b[HP_NUM];
+  for (int i = 0; i < HP_NUM; ++i) hostperf_overhead[i] = UINT64_MAX;
+  for (int n = 0; n < 1000; ++n) {
+    hostperfRead(a);
+    hostperfRead(b);
+    for (int i = 0; i < HP_NUM; ++i) {
+      if (b[i] - a[i] < hostperf_overhead[i]) hostperf_overhead[i] = b[i] - a[i];
+    }
+  }
+}
+
+void hostperfBegin() {
+  if (hostperf_fd != -1) hostperfRead(hostperf_start);
+}
+
+void hostperfEnd(uint32_t pc, const char* op) {
+  hostperf_countdown = HOSTPERF_EVERY;
+  if (hostperf_fd == -1) return;
+  uint64_t end[HP_NUM], d[HP_NUM];
+  hostperfRead(end);
+  for (int i = 0; i < HP_NUM; ++i) {
+    d[i] = end[i] - hostperf_start[i];
+    d[i] = d[i] > hostperf_overhead[i] ? d[i] - hostperf_overhead[i] : 0;
+  }
+
+  int id = op ? mnemonicId(op) : -1;
+  if (id >= 0) {
+    HostPerfOp* e = &hostperf_ops[id];
+    ++e->count;
+    for (int k = 0; k < HP_NUM; ++k) e->ctr[k] += d[k];
+  }
+
+  uint32_t i = (pc >> 2) * 2654435761u & (HOSTPERF_PCS - 1);
+  for (int probe = 0; probe < HOSTPERF_PCS; ++probe, i = (i + 1) & (HOSTPERF_PCS - 1)) {
+    HostPerfPc* e = &hostperf_pcs[i];
+    if (e->pc != pc) {
+      if (e->pc != 0) continue;
+      if (hostperf_pc_num >= HOSTPERF_PCS / 2) break;  // Keep probes short.
+      e->pc = pc;
+      ++hostperf_pc_num;
+    }
+    ++e->count;
+    for (int k = 0; k < HP_NUM; ++k) e->ctr[k] += d[k];
+    return;
+  }
+  ++hostperf_lost;
+}
+
+// Sort orders for the dump; the tables stay hashed for further counting.
+int hostperf_op_order[MNEMONIC_MAX], hostperf_pc_order[HOSTPERF_PCS];
+
+int hostperfOpCmp(const void* a, const void* b) {
+  uint64_t x = hostperf_ops[*(const int*)a].ctr[HP_CYCLES];
+  uint64_t y = hostperf_ops[*(const int*)b].ctr[HP_CYCLES];
+  return (x < y) - (x > y);  // Descending.
+}
+
+int hostperfPcCmp(const void* a, const void* b) {
+  uint64_t x = hostperf_pcs[*(const int*)a].ctr[HP_CYCLES];
+  uint64_t y = hostperf_pcs[*(const int*)b].ctr[HP_CYCLES];
+  return (x < y) - (x > y);  // Descending.
+}
+
+void hostperfDump() {
+  if (hostperf_fd == -1) return;
+  int ops = 0, pcs = 0;
+  for (int i = 0; i < MNEMONIC_MAX; ++i)
+    if (hostperf_ops[i].count) hostperf_op_order[ops++] = i;
+  for (int i = 0; i < HOSTPERF_PCS; ++i)
+    if (hostperf_pcs[i].count) hostperf_pc_order[pcs++] = i;
+  qsort(hostperf_op_order, ops, sizeof(int), hostperfOpCmp);
+  qsort(hostperf_pc_order, pcs, sizeof(int), hostperfPcCmp);
+
+  printf("\nHost cost per guest instruction (overhead subtracted: %llu %s)\n",
+         (unsigned long long)hostperf_overhead[HP_CYCLES], hostperf_names[HP_CYCLES]);
+  printf("%-12s %12s %10s %10s %12s %12s\n", "mnemonic", "measured",
+         "cycles", "insts", "cmiss/1k", "bmiss/1k");
+  for (int i = 0; i < ops; ++i) {
+    HostPerfOp* e = &hostperf_ops[hostperf_op_order[i]];
+    double n = e->count;
+    printf("%-12s %12llu %10.1f %10.1f %12.2f %12.2f\n",
+           mnemonicName(hostperf_op_order[i]),
+           (unsigned long long)e->count, e->ctr[HP_CYCLES] / n,
+           e->ctr[HP_INSTS] / n, 1000 * e->ctr[HP_CACHE_MISS] / n,
+           1000 * e->ctr[HP_BRANCH_MISS] / n);
+  }
+
+  printf("\n%-10s %12s %10s %10s %12s %12s  %s\n", "pc", "measured", "cycles",
+         "insts", "cmiss/1k", "bmiss/1k", "function");
+  for (int i = 0; i < HOSTPERF_TOP && i < pcs; ++i) {
+    HostPerfPc* e = &hostperf_pcs[hostperf_pc_order[i]];
+    double n = e->count;
+    printf("0x%-8x %12llu %10.1f %10.1f %12.2f %12.2f  %s\n", e->pc,
+           (unsigned long long)e->count, e->ctr[HP_CYCLES] / n,
+           e->ctr[HP_INSTS] / n, 1000 * e->ctr[HP_CACHE_MISS] / n,
+           1000 * e->ctr[HP_BRANCH_MISS] / n, symName(e->pc));
+  }
+  if (hostperf_lost)
+    printf("%llu measurements at untracked pcs\n", (unsigned long long)hostperf_lost);
+}
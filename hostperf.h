@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host performance counters attributed to guest instructions, enabled with
+// -DHOST_PERF (Linux hosts only). Host cycles, instructions, cache misses and
+// branch misses are read through perf_event_open around the decode/execute
+// region of every HOSTPERF_EVERY-th instruction and aggregated by guest
+// mnemonic and pc. Needs perf_event_paranoid <= 2 (user-space counting).
+
+#ifndef HOSTPERF_EVERY
+#define HOSTPERF_EVERY 1
+#endif
+#ifndef HOSTPERF_TOP
+#define HOSTPERF_TOP 16  // Hottest guest pcs listed at exit.
+#endif
+
+enum HostPerfCounter {
+  HP_CYCLES, HP_INSTS, HP_CACHE_MISS, HP_BRANCH_MISS, HP_NUM
+};
+
+extern uint32_t hostperf_countdown;
+
+// True if this instruction should be measured.
+#define HOSTPERF_DUE() (--hostperf_countdown == 0)
+
+// Open the counters (once) and clear the statistics.
+void hostperfReset();
+
+// Snapshot the counters before the measured region.
+void hostperfBegin();
+
+// Snapshot after the region and charge it to the instruction at pc with
+// disassembly op, or to pc alone if op is NULL.
+void hostperfEnd(uint32_t pc, const char* op);
+
+void hostperfDump();
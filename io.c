@@ -1,5 +1,11 @@
 #include <stdio.h>
 #include <string.h>
+#ifndef __NIOS2__
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#endif
 
 #include "io.h"
 
@@ -14,6 +20,10 @@
 #define TERM_W 40
 #define TERM_H 21
 
+#ifndef KEY_BACKOFF
+#define KEY_BACKOFF 20000  // Idle key-register polls per waitKeys call.
+#endif
+
 char char_buf[CHAR_H][CHAR_W];
 int row_count_l = 0;
 int row_count_r = 0;
@@ -54,6 +64,30 @@ void clear_screen() {
     }
   }
 }
+#elif defined(KEY_FD)
+int key_fd = -1;        // KEY_FD while open; -1 after end of input.
+int key_countdown = 1;  // readKeys calls until the fd is polled again.
+
+// Key bit of the next key byte on key_fd, up to timeout_ms (-1: no timeout).
+// One byte per call, so repeated presses are not merged.
+int readKeyFd(int timeout_ms) {
+  struct pollfd p = {key_fd, POLLIN, 0};
+  char c;
+  while (poll(&p, 1, timeout_ms) > 0) {
+    if (read(key_fd, &c, 1) <= 0) {  // Writer gone: no more keys.
+      key_fd = -1;
+      return 0;
+    }
+    switch (c) {
+      case '0': case 's': return 0b1;
+      case '1': case 'p': return 0b10;
+      case '2': case 'b': return 0b100;
+      case '3': case 'r': return 0b1000;
+    }
+    timeout_ms = 0;  // Skip other bytes, e.g. newlines.
+  }
+  return 0;
+}
 #endif
 
 void updateCharBuf() {
@@ -70,6 +104,9 @@ void resetIO(){
 #ifdef __NIOS2__
   clear_screen();
   *PB_EDGECAPTURE = -1;
+#elif defined(KEY_FD)
+  key_fd = fcntl(KEY_FD, F_GETFD) == -1 ? -1 : KEY_FD;
+  key_countdown = 1;
 #endif
 }
 
@@ -135,6 +172,11 @@ int readKeys(){
   int PBreleases = *PB_EDGECAPTURE;
   *PB_EDGECAPTURE = -1;
   return PBreleases;
+#elif defined(KEY_FD)
+  if (key_fd < 0 || --key_countdown) return 0;
+  int keys = readKeyFd(0);
+  key_countdown = keys ? 1 : KEY_POLL;  // Hand out queued presses next.
+  return keys;
 #endif
   return 0;
 }
@@ -148,6 +190,40 @@ void updateLEDs() {
 int readSwitches() {
 #ifdef __NIOS2__
   return *SWITCHES;
+#endif
+  return 0;
+}
+
+uint64_t readTimeUs() {
+#ifdef __NIOS2__
+  return 0;  // No free-running timer wired up on the board.
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+bool waitKeys(int64_t timeout_us) {
+#ifdef __NIOS2__
+  // Nothing to block on and no timer: poll the key register at a slower
+  // pace than the emulator loop, which refreshes the LEDs between calls.
+  (void)timeout_us;
+  for (int i = 0; i < KEY_BACKOFF && !*PB_EDGECAPTURE; ++i) continue;
+  return true;
+#else
+#ifdef KEY_FD
+  if (key_fd >= 0) {
+    struct pollfd p = {key_fd, POLLIN, 0};
+    int ms = timeout_us < 0 ? -1 : (int)((timeout_us + 999) / 1000);
+    if (poll(&p, 1, ms) > 0) key_countdown = 1;  // readKeys takes it next.
+    return true;
+  }
+#endif
+  if (timeout_us < 0) return false;  // Nothing would ever wake us.
+  struct timespec ts = {timeout_us / 1000000, timeout_us % 1000000 * 1000};
+  nanosleep(&ts, NULL);
+  return true;
 #endif
 }
 
@@ -1,7 +1,16 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
+// Off the board, keys are read from file descriptor KEY_FD when built with
+// -DKEY_FD=n, e.g. -DKEY_FD=3 and ./main 3<keys.fifo. Each byte presses a
+// key: '0' or 's' step, '1' or 'p' pause/continue, '2' or 'b' back
+// (-DREVERSE), '3' or 'r' reset. End of input stops key input.
+#ifndef KEY_POLL
+#define KEY_POLL 4096  // readKeys calls between polls of KEY_FD.
+#endif
+
 void resetIO();
 
 void decodePuts(char* str);
@@ -15,3 +24,20 @@ void updateCharBuf();
 int readKeys();
 void updateLEDs();
 int readSwitches();
+
+// Free-running timer in microseconds (backs the time CSR).
+uint64_t readTimeUs();
+
+// Wait for a key press, up to timeout_us (-1: no timeout), without using
+// the CPU off the board; the next readKeys returns the press. On the board
+// it backs off for a while and returns. Returns false if there is no key
+// source and no timeout, so the wait would never end.
+bool waitKeys(int64_t timeout_us);
+
+// Guest-visible external inputs, for record/replay and reverse execution.
+enum InputType {
+  INPUT_KEYS = 1,  // readKeys(), polled every loop iteration.
+  INPUT_SWITCHES,  // readSwitches() for ecall 200.
+  INPUT_TIME,      // time CSR, in us since reset.
+  INPUT_SYSCALL,   // newlib system call result and the memory it filled.
+};
@@ -3,18 +3,107 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "elf.h"
+#include "fpu.h"
 #include "io.h"
+#include "probes.h"
+#include "rvc.h"
+#include "sym.h"
+#include "sys.h"
+#include "vec.h"
+#ifdef INST_HIST
+#include "hist.h"
+#endif
+#ifdef PC_PROF
+#include "pcprof.h"
+#endif
+#ifdef CALL_PROF
+#include "callprof.h"
+#endif
+#ifdef CALL_TRACE
+#include "trace.h"
+#endif
+#ifdef MEM_PROF
+#include "memprof.h"
+#endif
+#ifdef HOST_PERF
+#include "hostperf.h"
+#endif
+#ifdef METRICS
+#include "metrics.h"
+#endif
+#ifdef NATIVE_LIB
+#include "native.h"
+#endif
+#ifdef COVERAGE
+#include "cov.h"
+#endif
+#ifdef CACHE_SIM
+#include "cache.h"
+#endif
+#ifdef MMU
+#define TRAPS  // S-mode and page faults go through the trap machinery.
+#include "mmu.h"
+#else
+#define MMU_PAGING() false
+#endif
+#ifdef TRAPS
+#include "trap.h"
+#endif
+#ifdef PIPE_MODEL
+#include "pipe.h"
+#define PIPE_MISS() pipeCacheMiss()
+#else
+#define PIPE_MISS() ((void)0)
+#endif
+#if defined(RECORD) || defined(REPLAY)
+#include "replay.h"
+#define LIVE_INPUT(type, value) replayInput(type, value, instret)
+#define LIVE_SYS_CALL() replaySysCall(reg, memory, MEM_SIZE, instret)
+#else
+#define LIVE_INPUT(type, value) (value)
+#define LIVE_SYS_CALL() sysCall(reg, memory, MEM_SIZE)
+#endif
+#ifdef REVERSE
+#include "rev.h"
+// Re-execution after going back takes guest inputs from the journal. at is
+// the instret of the instruction taking the input; handleEcall runs after
+// the ecall retired, so its inputs are at instret - 1.
+#define INPUT_AT(type, value, at)       \
+  (REV_REPLAYING(at)                    \
+       ? revInput(type, 0, at)          \
+       : revInput(type, LIVE_INPUT(type, value), at))
+#define SYS_CALL()                                         \
+  (ECALL_REPLAYING()                                       \
+       ? revSysReplay(reg, memory, MEM_SIZE, instret - 1)  \
+       : revSysRecord(reg, memory, instret - 1, LIVE_SYS_CALL()))
+// In handleEcall: the ecall ran before going back; skip its terminal output.
+#define ECALL_REPLAYING() REV_REPLAYING(instret - 1)
+#else
+#define INPUT_AT(type, value, at) LIVE_INPUT(type, value)
+#define SYS_CALL() LIVE_SYS_CALL()
+#define ECALL_REPLAYING() false
+#endif
+#define INPUT(type, value) INPUT_AT(type, value, instret)
+#ifdef FUZZ
+#define BATCH  // Unattended: no trace, leave the loop when the guest exits.
+#include "fuzz.h"
+#endif
 
 // Include file storing elf in char array.
+// Build with -DELF_HEADER='"path/rvelf.h"' to run another guest.
+#ifdef ELF_HEADER
+#include ELF_HEADER
+#else
 #include "rvelf.h"
+#endif
 #define ELF_ARR rvelf
 #define ELF_ARR_LEN rvelf_len
 
 // Memory layout.
 #define MEM_START 0x0
 #define MEM_SIZE 0x100000  // 1MiB
-// #define IO_START 0x100000
-// #define IO_SIZE 0xFFF      // 4KiB
+// The IO region (CLINT) follows memory; see trap.h.
 uint8_t memory[MEM_SIZE];
 
 // Convert memory to target data width.
@@ -44,21 +133,37 @@ enum RegName {
 // Registers.
 uint32_t reg[REG_NUM] = {0};
 uint32_t pc = 0;
+uint32_t inst_pc = 0;  // Address of the executing instruction; pc is already past it.
+#ifdef MMU
+uint32_t inst_pa, inst_pa_hi;  // Physical addresses of its halves.
+#else
+#define inst_pa inst_pc
+#define inst_pa_hi (inst_pc + 2)
+#endif
 
-// ELF header.
-#define ELFMAG_W0 0x464C457F /* 7F E L F */
-#define ELFMAG_W4 0x00010101 /* 32-bit, LSB, SysV ABI */
-#define ET_EXEC 2            /* Executable file */
-#define EM_RISCV 243         /* RISC-V */
-typedef struct {
-  uint8_t e_ident[16]; /* Magic number and other info */
-  uint16_t e_type;     /* Object file type */
-  uint16_t e_machine;  /* Architecture */
-  uint32_t e_version;  /* Object file version */
-  uint32_t e_entry;    /* Entry point virtual address */
-} Elf32_Ehdr;
+// Performance counters (Zicntr). cycle tracks instret: one instruction per cycle.
+uint64_t instret = 0;
+uint64_t cycle = 0;
+uint64_t time_base = 0;  // Host time at reset, in microseconds.
+
+// Guest time in us since reset, read by the time CSR and CLINT mtime: the
+// host clock (an external input), or with -DVIRTUAL_TIME=n one us per n
+// retired instructions.
+uint64_t guestTime() {
+#ifdef VIRTUAL_TIME
+  uint64_t t = instret / VIRTUAL_TIME;
+#else
+  uint64_t t = INPUT(INPUT_TIME, readTimeUs() - time_base);
+#endif
+#ifdef TRAPS
+  t += trap.mtime_offset;
+#endif
+  return t;
+}
 
 // Load elf from array.
+uint32_t image_end = 0;  // First byte past the loaded program.
+
 int load() {
   char msg[40] = {0};
   // Check ELF size.
@@ -82,8 +187,22 @@ int load() {
   } else {
     pc = elf_h->e_entry; // Set pc to entry point.
     sprintf(msg, "load: entry point address 0x%x", pc);
+    // End of the loadable segments (including .bss): the initial brk.
+    image_end = ELF_ARR_LEN;
+    for (uint32_t i = 0; i < elf_h->e_phnum; ++i) {
+      uint32_t off = elf_h->e_phoff + i * sizeof(Elf32_Phdr);
+      if (off + sizeof(Elf32_Phdr) > ELF_ARR_LEN) break;
+      Elf32_Phdr *ph = (Elf32_Phdr *)&memory[off];
+      if (ph->p_type == PT_LOAD && ph->p_vaddr + ph->p_memsz > image_end)
+        image_end = ph->p_vaddr + ph->p_memsz;
+    }
   }
   termPuts(msg);
+  PROBE3(load, pc, ELF_ARR_LEN, ret_val);
+  if (!ret_val && symLoad(ELF_ARR, ELF_ARR_LEN)) {
+    sprintf(msg, "load: %d symbols", sym_num);
+    termPuts(msg);
+  }
   return ret_val;
 }
 
@@ -133,21 +252,226 @@ typedef enum OpcodeVal {
   S_Store   = 0b0100011, // Store.
   I_OpImm   = 0b0010011, // Immediate computation.
   R_Op      = 0b0110011, // Register computation.
-  I_MiscMem = 0b0001111, // FENCE (unimplemented).
-  Iu_System  = 0b1110011  // ECALL & EBREAK.
+  I_MiscMem = 0b0001111, // FENCE / FENCE.I (no-ops).
+  I_LoadFp  = 0b0000111, // FP and vector loads.
+  S_StoreFp = 0b0100111, // FP and vector stores.
+  R_OpFp    = OP_FP,     // FP computation.
+  R4_FMadd  = OP_FMADD,  // Fused multiply-add (R4: rs3 in funct5).
+  R4_FMsub  = OP_FMSUB,
+  R4_FNMsub = OP_FNMSUB,
+  R4_FNMadd = OP_FNMADD,
+  V_Op      = OP_V,      // Vector arithmetic and vsetvl.
+  Iu_System  = 0b1110011  // ECALL, EBREAK & CSR instructions.
 } Opcode_T;
 
+// CSR addresses.
+enum CsrAddr {
+  CSR_CYCLE    = 0xC00,
+  CSR_TIME     = 0xC01,
+  CSR_INSTRET  = 0xC02,
+  CSR_CYCLEH   = 0xC80,
+  CSR_TIMEH    = 0xC81,
+  CSR_INSTRETH = 0xC82,
+};
+
 bool f_pause = false;
 bool f_step = false;
 bool f_ecall = false;
 bool f_exit = false;
+bool f_wfi = false;  // Waiting for an interrupt (-DTRAPS).
+bool f_fault = false;  // Stopped by a memory or fetch fault, not an exit.
+bool f_invalid = false;  // Current instruction was illegal or faulted.
+int32_t exit_code = -1;  // Set by the exit ecall; -1 for faults.
+
+// Report collected statistics once the guest exits.
+void exitReport() {
+#ifdef FUZZ
+  if (fuzzPersisting()) return;  // Report once, after the last input.
+#endif
+#ifdef BATCH
+  uint64_t us = readTimeUs() - time_base;
+  printf("retired %llu instructions in %llu us, %.2f MIPS\n",
+         (unsigned long long)instret, (unsigned long long)us,
+         us ? (double)instret / us : 0.0);
+#endif
+#ifdef INST_HIST
+  histDump(instret);
+#endif
+#ifdef PC_PROF
+  pcprofDump();
+#endif
+#ifdef CALL_PROF
+  callprofDump(instret);
+#endif
+#ifdef CALL_TRACE
+  traceFlush(instret);
+#endif
+#ifdef MEM_PROF
+  memprofDump();
+#endif
+#ifdef HOST_PERF
+  hostperfDump();
+#endif
+#ifdef METRICS
+  metricsExit(pc, instret, exit_code);
+#endif
+#ifdef NATIVE_LIB
+  nativeDump();
+#endif
+#ifdef FUZZ
+  fuzzDump();
+#endif
+#ifdef COVERAGE
+  covDump(ELF_ARR, ELF_ARR_LEN, memory);
+#endif
+#ifdef CACHE_SIM
+  cacheDump();
+#endif
+#ifdef PIPE_MODEL
+  pipeDump(instret);
+#endif
+#if defined(RECORD) || defined(REPLAY)
+  replayDump();
+#endif
+#ifdef MMU
+  mmuDump();
+#endif
+}
+
+#ifdef REVERSE
+uint64_t rev_target = REV_NONE;  // Re-executing up to this instret.
+
+void reverseSnapshot() {
+  RevCpu cpu;
+  memcpy(cpu.reg, reg, sizeof(reg));
+  memcpy(cpu.freg, freg, sizeof(freg));
+  memcpy(cpu.vreg, vreg, 32 * VLENB);
+  cpu.pc = pc;
+  cpu.instret = instret;
+  cpu.cycle = cycle;
+  cpu.fcsr = fcsr;
+  cpu.vl = vl;
+  cpu.vtype = vtype;
+  cpu.trap = trap;
+  cpu.trap_poll_at = trap_poll_at;
+  revSnapshot(&cpu, memory);
+}
+
+// Go back to instret target: restore the nearest snapshot and re-execute up
+// to target, where the main loop pauses. Returns false if there is no
+// snapshot that old.
+bool reverseTo(uint64_t target) {
+  RevCpu cpu;
+  if (target >= instret || !revRestore(target, instret, &cpu, memory))
+    return false;
+  memcpy(reg, cpu.reg, sizeof(reg));
+  memcpy(freg, cpu.freg, sizeof(freg));
+  memcpy(vreg, cpu.vreg, 32 * VLENB);
+  pc = cpu.pc;
+  instret = cpu.instret;
+  cycle = cpu.cycle;
+  fcsr = cpu.fcsr;
+  vl = cpu.vl;
+  vtype = cpu.vtype;
+  trap = cpu.trap;
+  trap_poll_at = cpu.trap_poll_at;
+#ifdef MMU
+  mmuFlush();  // Page tables and satp may differ.
+#endif
+  f_pause = f_exit = f_fault = f_wfi = false;
+  exit_code = -1;
+  rev_target = target;
+  return true;
+}
+#endif
+
+#ifdef FUZZ
+#if FUZZ_PERSIST
+// Guest state before the first input read, restored for every further input
+// a persistent-mode child runs.
+struct {
+  uint8_t memory[MEM_SIZE];
+  uint32_t reg[REG_NUM], pc;
+  uint64_t instret, cycle, freg[32];
+  uint32_t fcsr, vl, vtype;
+  uint8_t vreg[32 * VLENB];
+#ifdef TRAPS
+  TrapState trap;
+  uint64_t trap_poll_at;
+#endif
+  SysState sys;
+} fuzz_snap;
+#endif
+
+void fuzzSave() {
+#if FUZZ_PERSIST
+  memcpy(fuzz_snap.memory, memory, MEM_SIZE);
+  memcpy(fuzz_snap.reg, reg, sizeof(reg));
+  memcpy(fuzz_snap.freg, freg, sizeof(freg));
+  memcpy(fuzz_snap.vreg, vreg, 32 * VLENB);
+  fuzz_snap.pc = pc;
+  fuzz_snap.instret = instret;
+  fuzz_snap.cycle = cycle;
+  fuzz_snap.fcsr = fcsr;
+  fuzz_snap.vl = vl;
+  fuzz_snap.vtype = vtype;
+#ifdef TRAPS
+  fuzz_snap.trap = trap;
+  fuzz_snap.trap_poll_at = trap_poll_at;
+#endif
+  sysSave(&fuzz_snap.sys);
+#endif
+}
+
+void fuzzRestore() {
+#if FUZZ_PERSIST
+  memcpy(memory, fuzz_snap.memory, MEM_SIZE);
+  memcpy(reg, fuzz_snap.reg, sizeof(reg));
+  memcpy(freg, fuzz_snap.freg, sizeof(freg));
+  memcpy(vreg, fuzz_snap.vreg, 32 * VLENB);
+  pc = fuzz_snap.pc;
+  instret = fuzz_snap.instret;
+  cycle = fuzz_snap.cycle;
+  fcsr = fuzz_snap.fcsr;
+  vl = fuzz_snap.vl;
+  vtype = fuzz_snap.vtype;
+#ifdef TRAPS
+  trap = fuzz_snap.trap;
+  trap_poll_at = fuzz_snap.trap_poll_at;
+#endif
+  sysRestore(&fuzz_snap.sys);
+#ifdef MMU
+  mmuFlush();
+#endif
+#endif
+}
+#endif
 
 void handleEcall(){
   f_ecall = false;
   char term_str[40] = {'\0'};
+  // newlib system call (number in a7)?
+  bool newlib = sysName(reg[_a7]) != NULL;
+#ifdef METRICS
+  metricsEcall(newlib ? reg[_a7] : reg[_a0]);
+#endif
+  if (newlib) {
+    if (SYS_CALL()) {
+      f_exit = true;
+      exit_code = reg[_a0];
+      sprintf(term_str, "exit with code %d", reg[_a0]);
+      termPuts(term_str);
+    }
+    return;
+  }
+  // Re-executing after going back: these printed the first time round.
+  if (ECALL_REPLAYING() &&
+      (reg[_a0] == 100 || reg[_a0] == 101 || reg[_a0] == 103))
+    return;
   switch (reg[_a0]) {
     case 0:  // exit (status code)
       f_exit = true;
+      exit_code = reg[_a1];
       sprintf(term_str, "exit with code %d", reg[_a1]);
       break;
     case 100:  // print (signed decimal)
@@ -168,7 +492,16 @@ void handleEcall(){
       sprintf(term_str, "Registers printed to terminal.");
       break;
     case 200:  // read int from switches
-      reg[_a0] = readSwitches();
+#ifdef FUZZ
+      // Fuzz input byte; the first read ends the warm-up.
+      if (!fuzz_started) {
+        fuzzSave();
+        fuzzStart();
+      }
+      reg[_a0] = fuzzByte();
+#else
+      reg[_a0] = INPUT_AT(INPUT_SWITCHES, (uint32_t)readSwitches(), instret - 1);
+#endif
       sprintf(term_str, "<< %d", reg[_a0]);
       break;
     default:
@@ -178,9 +511,141 @@ void handleEcall(){
   termPuts(term_str);
 }
 
+#ifdef TRAPS
+// Take exception cause for the current instruction if the guest installed
+// a trap handler. Returns false if it did not.
+bool raiseException(uint32_t cause, uint32_t tval) {
+  if (!trap.mtvec || trap.mtvec >= MEM_SIZE) return false;
+  pc = trapEnter(cause, tval, inst_pc);
+  return true;
+}
+#endif
+
+// Guest accessed memory outside memory[]: trap to its handler or stop it.
+void memFault(uint32_t addr, bool store, char *out_op) {
+  f_invalid = true;
+#ifdef TRAPS
+  if (raiseException(store ? CAUSE_STORE_ACCESS : CAUSE_LOAD_ACCESS, addr)) {
+    sprintf(out_op, "%s access fault at 0x%x", store ? "store" : "load", addr);
+    return;
+  }
+#endif
+  f_exit = f_fault = true;
+  PROBE3(mem_fault, addr, inst_pc, store);
+  sprintf(out_op, "%s fault at 0x%x", store ? "store" : "load", addr);
+}
+
+// Instruction not implemented or not permitted: trap if the guest handles
+// it; otherwise it is skipped.
+void illegalInst(uint32_t inst) {
+  f_invalid = true;
+#ifdef TRAPS
+  raiseException(CAUSE_ILLEGAL_INST, inst);
+#else
+  (void)inst;
+#endif
+}
+
+#ifdef MMU
+// Translate the virtual address addr (an lvalue) of a width-byte access to
+// a physical one in place. A TLB hit costs a mask and a compare; anything
+// else goes to translateMiss. False if the access must not go ahead.
+#define TRANSLATE(addr, width, acc)                            \
+  (MMU_HIT(addr, width, acc) ? ((addr) = MMU_PA(addr), true) \
+                             : translateMiss(&(addr), width, acc, out_op))
+
+// Take the trap for cause at tval, or stop the guest if it has no handler.
+void translateFault(uint32_t cause, uint32_t tval, int acc, char *out_op) {
+  static const char *names[3] = {"load", "store", "fetch"};
+  f_invalid = true;
+  if (raiseException(cause, tval)) {
+    sprintf(out_op, "%s fault at 0x%x (cause %d)", names[acc], tval, cause);
+    return;
+  }
+  f_exit = f_fault = true;
+  PROBE3(mem_fault, tval, inst_pc, acc == ACC_STORE);
+  sprintf(out_op, "%s fault at 0x%x", names[acc], tval);
+}
+
+// TLB miss or misaligned access: walk the page table. An access crossing
+// into a page that is not physically next is reported as misaligned,
+// which the ISA allows.
+bool translateMiss(uint32_t *addr, uint32_t width, int acc, char *out_op) {
+  uint32_t va = *addr, tval = va, pa, pa_next;
+  uint32_t cause = mmuTranslate(va, acc, &pa);
+  if (!cause && (va & MMU_PAGE_MASK) > MMU_PAGE - width) {
+    tval = (va | MMU_PAGE_MASK) + 1;
+    cause = mmuTranslate(tval, acc, &pa_next);
+    if (!cause && pa_next != pa + (tval - va)) {
+      tval = va;
+      cause = acc == ACC_STORE ? CAUSE_STORE_MISALIGNED : CAUSE_LOAD_MISALIGNED;
+    }
+  }
+  if (cause) {
+    translateFault(cause, tval, acc, out_op);
+    return false;
+  }
+  *addr = pa;
+  return true;
+}
+
+// Fetch at pc missed the TLB or may cross a page: translate it into inst_pa
+// and inst_pa_hi. False if it trapped or stopped the guest.
+bool fetchMiss(char *out_op) {
+  uint32_t tval = pc, cause = mmuTranslate(pc, ACC_FETCH, &inst_pa);
+  if (!cause && inst_pa > MEM_SIZE - 2) cause = CAUSE_FETCH_ACCESS;
+  inst_pa_hi = inst_pa + 2;
+  if (!cause && (pc & MMU_PAGE_MASK) == MMU_PAGE - 2 &&
+      !IS_RVC(MEM_HALF_U(inst_pa))) {
+    tval = pc + 2;
+    cause = mmuTranslate(tval, ACC_FETCH, &inst_pa_hi);
+    if (!cause && inst_pa_hi > MEM_SIZE - 2) cause = CAUSE_FETCH_ACCESS;
+  }
+  if (!cause) return true;
+  inst_pc = pc;
+  translateFault(cause, tval, ACC_FETCH, out_op);
+  return false;
+}
+
+// Point x[rs1] of a LOAD-FP/STORE-FP at the physical address its access
+// translates to; the caller restores it. While paging, vector accesses
+// must fit in one page. False if the access must not go ahead.
+bool translateFpVec(uint32_t inst_u32, char *out_op) {
+  static const uint8_t width_bytes[8] = {1, 0, 0, 0, 0, 2, 4, 8};
+  if (!MMU_PAGING()) return true;  // Identity.
+  InstField *inst = (InstField *)&inst_u32;
+  int acc = (OPCODE(inst_u32)) == S_StoreFp ? ACC_STORE : ACC_LOAD;
+  uint32_t funct3 = inst->Is.funct3, rs1 = inst->Is.rs1;
+  int32_t imm = 0;
+  uint32_t addr = reg[rs1];
+  if (VEC_WIDTH(funct3)) {
+    uint32_t mop = (inst_u32 >> 26) & 3, eb = width_bytes[funct3];
+    uint32_t stride = mop == 0b10 ? reg[(inst_u32 >> 20) & 31] : eb;
+    if (!vl || (mop & 1)) return true;  // No access, or rejected by vec.c.
+    uint64_t span = (uint64_t)(vl - 1) * stride + eb;
+    if (span > MMU_PAGE - (addr & MMU_PAGE_MASK)) {
+      sprintf(out_op, "vector access across pages");
+      illegalInst(inst_u32);
+      return false;
+    }
+    if (!TRANSLATE(addr, 1, acc)) return false;
+  } else {
+    imm = acc == ACC_STORE ? inst->S.imm4_0 + (inst->S.imm11_5 << 5)
+                           : inst->Is.imm11_0;
+    addr += imm;
+    if (!TRANSLATE(addr, funct3 == 0b011 ? 8 : 4, acc)) return false;
+  }
+  reg[rs1] = addr - imm;
+  return true;
+}
+#endif
+
+// Access width in bytes from the load/store funct3.
+#define MEM_WIDTH(funct3) (1u << ((funct3) & 0b11))
+
 void handleBranch(InstField *inst, char *out_op) {
-  uint32_t tgt = pc + ((-inst->B.imm12 << 12) | (inst->B.imm11 << 11) |
-                 (inst->B.imm10_5 << 5) | (inst->B.imm4_1 << 1)) - 4;
+  uint32_t tgt = inst_pc + ((-inst->B.imm12 << 12) | (inst->B.imm11 << 11) |
+                 (inst->B.imm10_5 << 5) | (inst->B.imm4_1 << 1));
   switch (inst->B.funct3) {
     case 0b000:  // BEQ
       if (reg[inst->R.rs1] == reg[inst->R.rs2]) pc = tgt;
@@ -207,10 +672,41 @@ void handleBranch(InstField *inst, char *out_op) {
       sprintf(out_op, "bgeu x%d, x%d, 0x%x", inst->B.rs1, inst->B.rs2, tgt);
       break;
   }
+#ifdef COVERAGE
+  COV_BRANCH(inst_pa, pc == tgt);
+#endif
+#ifdef FUZZ
+  FUZZ_EDGE(pc);
+#endif
 }
 
 void handleLoad(InstField *inst, char *out_op) {
   uint32_t addr = reg[inst->Is.rs1] + inst->Is.imm11_0;
+#ifdef CALL_PROF
+  ++callprof_mem;
+#endif
+#ifdef MMU
+  if (!TRANSLATE(addr, MEM_WIDTH(inst->Is.funct3), ACC_LOAD)) return;
+#endif
+#ifdef MEM_PROF
+  memprofLoad(addr);
+#endif
+  if (addr > MEM_SIZE - MEM_WIDTH(inst->Is.funct3)) {
+#ifdef TRAPS
+    uint32_t io;
+    if (inst->Is.funct3 == 0b010 && clintLoad(addr, &io, guestTime())) {
+      reg[inst->Is.rd] = io;
+      sprintf(out_op, "lw x%d, %d(x%d)", inst->Is.rd, inst->Is.imm11_0, inst->Is.rs1);
+      return;
+    }
+#endif
+    memFault(addr, false, out_op);
+    return;
+  }
+#ifdef CACHE_SIM
+  if (!cacheData(addr, MEM_WIDTH(inst->Is.funct3), false, inst_pc))
+    PIPE_MISS();
+#endif
   switch (inst->Is.funct3) {
     case 0b000: // LB
       reg[inst->Is.rd] = MEM_BYTE_S(addr);
@@ -234,6 +730,7 @@ void handleLoad(InstField *inst, char *out_op) {
       break;
     default:
       sprintf(out_op, "unknown load");
+      illegalInst(*(uint32_t *)inst);
       break;
   }
 }
@@ -241,6 +738,30 @@ void handleLoad(InstField *inst, char *out_op) {
 void handleStore(InstField *inst, char *out_op) {
   int32_t offset = inst->S.imm4_0 + (inst->S.imm11_5 << 5);
   uint32_t addr = reg[inst->S.rs1] + offset;
+#ifdef CALL_PROF
+  ++callprof_mem;
+#endif
+#ifdef MMU
+  if (!TRANSLATE(addr, MEM_WIDTH(inst->S.funct3), ACC_STORE)) return;
+#endif
+#ifdef MEM_PROF
+  memprofStore(addr);
+#endif
+  if (addr > MEM_SIZE - MEM_WIDTH(inst->S.funct3)) {
+#ifdef TRAPS
+    if (inst->S.funct3 == 0b010 &&
+        clintStore(addr, reg[inst->S.rs2], guestTime())) {
+      sprintf(out_op, "sw x%d, %d(x%d)", inst->S.rs2, offset, inst->Is.rs1);
+      return;
+    }
+#endif
+    memFault(addr, true, out_op);
+    return;
+  }
+#ifdef CACHE_SIM
+  if (!cacheData(addr, MEM_WIDTH(inst->S.funct3), true, inst_pc))
+    PIPE_MISS();
+#endif
   switch (inst->S.funct3) {
     case 0b000: // SB
       MEM_BYTE_S(addr) = reg[inst->S.rs2];
@@ -256,11 +777,154 @@ void handleStore(InstField *inst, char *out_op) {
       break;
     default:
       sprintf(out_op, "unknown store");
+      illegalInst(*(uint32_t *)inst);
       break;
   }
 }
 
+// RV32M: multiply/divide, computed with host 64-bit arithmetic.
+void handleMulDiv(InstField *inst, char *out_op) {
+  static const char *names[8] = {
+    "mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu"};
+  uint32_t a = reg[inst->R.rs1], b = reg[inst->R.rs2];
+  int32_t sa = (int32_t)a, sb = (int32_t)b;
+  uint32_t res;
+  switch (inst->R.funct3) {
+    case 0b000:  // MUL
+      res = a * b;
+      break;
+    case 0b001:  // MULH
+      res = ((int64_t)sa * sb) >> 32;
+      break;
+    case 0b010:  // MULHSU
+      res = ((int64_t)sa * (int64_t)b) >> 32;
+      break;
+    case 0b011:  // MULHU
+      res = ((uint64_t)a * b) >> 32;
+      break;
+    case 0b100:  // DIV: x/0 = -1, INT_MIN/-1 = INT_MIN
+      if (b == 0) res = -1;
+      else if (sa == INT32_MIN && sb == -1) res = INT32_MIN;
+      else res = sa / sb;
+      break;
+    case 0b101:  // DIVU: x/0 = 2^32-1
+      res = b == 0 ? UINT32_MAX : a / b;
+      break;
+    case 0b110:  // REM: x%0 = x, INT_MIN%-1 = 0
+      if (b == 0) res = a;
+      else if (sa == INT32_MIN && sb == -1) res = 0;
+      else res = sa % sb;
+      break;
+    default:  // REMU: x%0 = x
+      res = b == 0 ? a : a % b;
+      break;
+  }
+  reg[inst->R.rd] = res;
+  sprintf(out_op, "%s x%d, x%d, x%d", names[inst->R.funct3], inst->R.rd,
+          inst->R.rs1, inst->R.rs2);
+}
+
+// Zba/Zbb/Zbs: bit manipulation, mapped onto host bit instructions through
+// compiler builtins (popcnt, lzcnt/tzcnt, rol/ror, bswap). Selected by
+// funct7 and funct3 together.
+#define BIT_OP(funct7, funct3) ((funct7) << 3 | (funct3))
+
+uint32_t rotr(uint32_t x, uint32_t sh) {
+  return (x >> (sh & 31)) | (x << (-sh & 31));  // Compiles to ror.
+}
+
+void handleBitOp(InstField *inst, char *out_op) {
+  uint32_t a = reg[inst->R.rs1], b = reg[inst->R.rs2];
+  const char *name;
+  uint32_t res;
+  switch (BIT_OP(inst->R.funct7, inst->R.funct3)) {
+    case BIT_OP(0x10, 0b010): name = "sh1add"; res = (a << 1) + b; break;
+    case BIT_OP(0x10, 0b100): name = "sh2add"; res = (a << 2) + b; break;
+    case BIT_OP(0x10, 0b110): name = "sh3add"; res = (a << 3) + b; break;
+    case BIT_OP(0x20, 0b111): name = "andn"; res = a & ~b; break;
+    case BIT_OP(0x20, 0b110): name = "orn"; res = a | ~b; break;
+    case BIT_OP(0x20, 0b100): name = "xnor"; res = ~(a ^ b); break;
+    case BIT_OP(0x05, 0b100): name = "min"; res = (int32_t)a < (int32_t)b ? a : b; break;
+    case BIT_OP(0x05, 0b101): name = "minu"; res = a < b ? a : b; break;
+    case BIT_OP(0x05, 0b110): name = "max"; res = (int32_t)a > (int32_t)b ? a : b; break;
+    case BIT_OP(0x05, 0b111): name = "maxu"; res = a > b ? a : b; break;
+    case BIT_OP(0x30, 0b001): name = "rol"; res = rotr(a, -b); break;
+    case BIT_OP(0x30, 0b101): name = "ror"; res = rotr(a, b); break;
+    case BIT_OP(0x24, 0b001): name = "bclr"; res = a & ~(1u << (b & 31)); break;
+    case BIT_OP(0x14, 0b001): name = "bset"; res = a | (1u << (b & 31)); break;
+    case BIT_OP(0x34, 0b001): name = "binv"; res = a ^ (1u << (b & 31)); break;
+    case BIT_OP(0x24, 0b101): name = "bext"; res = (a >> (b & 31)) & 1; break;
+    case BIT_OP(0x04, 0b100):  // ZEXT.H (RV32 encoding of pack with rs2 = x0)
+      if (inst->R.rs2 != 0) goto unknown;
+      reg[inst->R.rd] = a & 0xFFFF;
+      sprintf(out_op, "zext.h x%d, x%d", inst->R.rd, inst->R.rs1);
+      return;
+    default:
+    unknown:
+      sprintf(out_op, "unknown op");
+      illegalInst(*(uint32_t *)inst);
+      return;
+  }
+  reg[inst->R.rd] = res;
+  sprintf(out_op, "%s x%d, x%d, x%d", name, inst->R.rd, inst->R.rs1,
+          inst->R.rs2);
+}
+
+void handleBitOpImm(InstField *inst, char *out_op) {
+  uint32_t a = reg[inst->R.rs1], sh = inst->R.rs2;  // shamt or sub-opcode
+  const char *name;
+  uint32_t res;
+  switch (BIT_OP(inst->R.funct7, inst->R.funct3)) {
+    case BIT_OP(0x30, 0b001):  // Unary Zbb ops, selected by rs2.
+      switch (sh) {
+        case 0: name = "clz"; res = a ? __builtin_clz(a) : 32; break;
+        case 1: name = "ctz"; res = a ? __builtin_ctz(a) : 32; break;
+        case 2: name = "cpop"; res = __builtin_popcount(a); break;
+        case 4: name = "sext.b"; res = (int8_t)a; break;
+        case 5: name = "sext.h"; res = (int16_t)a; break;
+        default: goto unknown;
+      }
+      reg[inst->R.rd] = res;
+      sprintf(out_op, "%s x%d, x%d", name, inst->R.rd, inst->R.rs1);
+      return;
+    case BIT_OP(0x14, 0b101):  // ORC.B
+      if (sh != 0b00111) goto unknown;
+      // High bit of each byte set iff the byte is nonzero, then widen.
+      res = (((a & 0x7F7F7F7F) + 0x7F7F7F7F) | a) & 0x80808080;
+      reg[inst->R.rd] = (res >> 7) * 0xFF;
+      sprintf(out_op, "orc.b x%d, x%d", inst->R.rd, inst->R.rs1);
+      return;
+    case BIT_OP(0x34, 0b101):  // REV8
+      if (sh != 0b11000) goto unknown;
+      reg[inst->R.rd] = __builtin_bswap32(a);
+      sprintf(out_op, "rev8 x%d, x%d", inst->R.rd, inst->R.rs1);
+      return;
+    case BIT_OP(0x30, 0b101): name = "rori"; res = rotr(a, sh); break;
+    case BIT_OP(0x24, 0b001): name = "bclri"; res = a & ~(1u << sh); break;
+    case BIT_OP(0x14, 0b001): name = "bseti"; res = a | (1u << sh); break;
+    case BIT_OP(0x34, 0b001): name = "binvi"; res = a ^ (1u << sh); break;
+    case BIT_OP(0x24, 0b101): name = "bexti"; res = (a >> sh) & 1; break;
+    default:
+    unknown:
+      sprintf(out_op, "unknown op-imm");
+      illegalInst(*(uint32_t *)inst);
+      return;
+  }
+  reg[inst->R.rd] = res;
+  sprintf(out_op, "%s x%d, x%d, %u", name, inst->R.rd, inst->R.rs1, sh);
+}
+
 void handleOp(InstField *inst, char *out_op) {
+  if (inst->R.funct7 == 0b0000001) {
+    handleMulDiv(inst, out_op);
+    return;
+  }
+  // Base ops use funct7 0, or 0b0100000 for SUB/SRA.
+  if (inst->R.funct7 != 0 && !(inst->R.funct7 == 0b0100000 &&
+      (inst->R.funct3 == 0b000 || inst->R.funct3 == 0b101))) {
+    handleBitOp(inst, out_op);
+    return;
+  }
   switch (inst->R.funct3) {
     case 0b000:  // ADD / SUB
       if (inst->R.funct7 == 0) {  // ADD
@@ -307,12 +971,20 @@ void handleOp(InstField *inst, char *out_op) {
       break;
     default:
       sprintf(out_op, "unknown op");
+      illegalInst(*(uint32_t *)inst);
       break;
   }
 }
 
 void handleOpImm(InstField *inst, char* out_op) {
   sprintf(out_op, "opimm");
+  // Shift-immediates use funct7 0, or 0b0100000 for SRAI.
+  if ((inst->R.funct3 == 0b001 && inst->R.funct7 != 0) ||
+      (inst->R.funct3 == 0b101 && inst->R.funct7 != 0 &&
+       inst->R.funct7 != 0b0100000)) {
+    handleBitOpImm(inst, out_op);
+    return;
+  }
   switch (inst->Is.funct3) {
     case 0b000:  // ADDI
       reg[inst->Is.rd] = (int32_t)reg[inst->Is.rs1] + inst->Is.imm11_0;
@@ -355,22 +1027,257 @@ void handleOpImm(InstField *inst, char* out_op) {
       break;
     default:
       sprintf(out_op, "unknown op-imm");
+      illegalInst(*(uint32_t *)inst);
       break;
   }
 }
 
+// Link registers for call/return detection (RISC-V return-address stack hints).
+#define IS_LINK(r) ((r) == _ra || (r) == _t0)
+
+// Guest jumped to target through a link register: a call returning to ret.
+void guestCall(uint32_t target, uint32_t ret) {
+#ifdef NATIVE_LIB
+  // Routine ran on the host: return at once, invisible to the profilers.
+  // Host routines take physical addresses, so not while paging.
+  if (!MMU_PAGING() && nativeCall(target, ret, reg, memory, MEM_SIZE)) {
+    pc = ret;
+    return;
+  }
+#endif
+#ifdef PC_PROF
+  pcprofCall(inst_pc, target, ret);
+#endif
+#ifdef CALL_PROF
+  callprofCall(target, ret, instret + 1);  // Count the jump in the caller.
+#endif
+#ifdef CALL_TRACE
+  traceCall(target, ret, instret + 1);
+#endif
+}
+
+// Guest jumped to target through a link register without linking: a return.
+void guestReturn(uint32_t target) {
+#ifdef NATIVE_LIB
+  nativeReturn(target, reg, memory);
+#endif
+#ifdef PC_PROF
+  pcprofReturn(target);
+#endif
+#ifdef CALL_PROF
+  callprofReturn(target, instret + 1);  // Count the return in the callee.
+#endif
+#ifdef CALL_TRACE
+  traceReturn(target, instret + 1);
+#endif
+}
+
+// Read a CSR into val. Returns false if the CSR does not exist.
+bool csrRead(uint32_t csr, uint32_t *val) {
+  uint64_t time = 0;
+  if (csr == CSR_TIME || csr == CSR_TIMEH) time = guestTime();
+  switch (csr) {
+    case CSR_CYCLE:    *val = cycle; break;
+    case CSR_TIME:     *val = time; break;
+    case CSR_INSTRET:  *val = instret; break;
+    case CSR_CYCLEH:   *val = cycle >> 32; break;
+    case CSR_TIMEH:    *val = time >> 32; break;
+    case CSR_INSTRETH: *val = instret >> 32; break;
+    default:
+#ifdef TRAPS
+      if (trapCsrRead(csr, val)) return true;
+#endif
+      return fpuCsrRead(csr, val) || vecCsrRead(csr, val);
+  }
+  return true;
+}
+
+// Write a CSR. Returns false if the CSR does not exist or is read-only.
+bool csrWrite(uint32_t csr, uint32_t val) {
+#ifdef TRAPS
+  if (trapCsrWrite(csr, val)) return true;
+#endif
+  return fpuCsrWrite(csr, val);  // The counters and vector CSRs are read-only.
+}
+
+void handleSystem(InstField *inst, char *out_op) {
+  static const char *csr_ops[8] = {
+    NULL, "csrrw", "csrrs", "csrrc", NULL, "csrrwi", "csrrsi", "csrrci"};
+  uint32_t funct3 = inst->Iu.funct3;
+  uint32_t csr = inst->Iu.imm11_0;
+  if (funct3 == 0b000) {
+    if (csr == 0x0) {  // ECALL
+#ifdef TRAPS
+      if (trap.priv != PRIV_M &&
+          raiseException(CAUSE_ECALL_U + trap.priv, 0)) {
+        sprintf(out_op, "ecall");
+        return;
+      }
+#endif
+      const char *sys_name = sysName(reg[_a7]);
+      if (sys_name) sprintf(out_op, "ecall (%s)", sys_name);
+      else sprintf(out_op, "ecall (%d)", reg[_a0]);
+      f_ecall = true;
+      // Call number and first argument: a7 and a0 for newlib, else a0, a1.
+      PROBE2(ecall, sys_name ? reg[_a7] : reg[_a0],
+             sys_name ? reg[_a0] : reg[_a1]);
+#ifdef CALL_TRACE
+      traceInstant(sys_name ? sys_name : "ecall", reg[_a0], instret);
+#endif
+    } else if (csr == 0x1) {  // EBREAK
+      sprintf(out_op, "ebreak");
+#ifdef REVERSE
+      revBreak(instret);
+#endif
+#ifndef BATCH
+      f_pause = true;  // Batch runs have nobody to press continue.
+#endif
+      PROBE1(ebreak, inst_pc);
+#ifdef CALL_TRACE
+      traceInstant("ebreak", reg[_a0], instret);
+#endif
+    } else if (csr == 0x105) {  // WFI (a nop without interrupts)
+      sprintf(out_op, "wfi");
+#ifdef TRAPS
+      f_wfi = true;
+    } else if (csr == 0x302 && trap.priv == PRIV_M) {  // MRET
+      pc = trapMret();
+      sprintf(out_op, "mret");
+    } else if (csr == 0x102 && trap.priv >= PRIV_S) {  // SRET
+      pc = trapSret();
+      sprintf(out_op, "sret");
+    } else if (csr >> 5 == 0b0001001 && trap.priv >= PRIV_S) {  // SFENCE.VMA
+#ifdef MMU
+      mmuFence(reg[inst->Iu.rs1], inst->Iu.rs1 == _zero);
+#endif
+      sprintf(out_op, "sfence.vma x%d, x%d", inst->Iu.rs1, csr & 0x1f);
+#endif
+    } else {
+      sprintf(out_op, "unknown system");
+      illegalInst(*(uint32_t *)inst);
+    }
+    return;
+  }
+  if (csr_ops[funct3] == NULL) {
+    sprintf(out_op, "unknown system");
+    illegalInst(*(uint32_t *)inst);
+    return;
+  }
+
+  // rs1 field holds a 5-bit zero-extended immediate for the *I forms.
+  uint32_t src = funct3 & 0b100 ? inst->Iu.rs1 : reg[inst->Iu.rs1];
+  bool write = (funct3 & 0b11) == 0b01 || inst->Iu.rs1 != 0;
+  uint32_t old = 0;
+  if (funct3 & 0b100)
+    sprintf(out_op, "%s x%d, 0x%x, %d", csr_ops[funct3], inst->Iu.rd, csr, src);
+  else
+    sprintf(out_op, "%s x%d, 0x%x, x%d", csr_ops[funct3], inst->Iu.rd, csr, inst->Iu.rs1);
+
+  if (!csrRead(csr, &old)) {
+    sprintf(out_op, "illegal csr 0x%x", csr);
+    illegalInst(*(uint32_t *)inst);
+    return;
+  }
+  if (write) {
+    uint32_t val = src;                                 // CSRRW
+    if ((funct3 & 0b11) == 0b10) val = old | src;       // CSRRS
+    else if ((funct3 & 0b11) == 0b11) val = old & ~src; // CSRRC
+    if (!csrWrite(csr, val)) {
+      sprintf(out_op, "illegal csr write 0x%x", csr);
+      illegalInst(*(uint32_t *)inst);
+      return;
+    }
+  }
+  reg[inst->Iu.rd] = old;
+}
+
 // #define QUIT_N(n) { printf("quit %d\n", n); return n; }
 
+// Nothing to run until a key press: block on the key source instead of
+// spinning. Returns false if no key press can arrive.
+bool idleWait() {
+#ifdef REPLAY
+  if (replayKeysDue(instret)) return true;  // Logged presses come first.
+#endif
+#ifdef METRICS
+  if (!f_exit) metricsUpdate(pc, instret, f_pause);  // Stale while blocked.
+#endif
+  return waitKeys(-1);
+}
+
 int main() {
 reset:
+  PROBE0(reset);
   resetIO();
-  f_pause = f_step = f_ecall = f_exit = false;
+  f_pause = f_step = f_ecall = f_exit = f_fault = f_wfi = false;
+  exit_code = -1;
+  instret = cycle = 0;
+  time_base = readTimeUs();
+  fpuReset();
+  vecReset();
+#ifdef INST_HIST
+  histReset();
+#endif
+#ifdef PC_PROF
+  pcprofReset();
+#endif
 
   // Load ELF into memory.
   if (load()) return 1;
+  sysReset(image_end);
+  // Clear the last run's registers: a stale a7 would send a0-numbered
+  // ecalls to sys.c.
+  memset(reg, 0, sizeof(reg));
+  // Start with sp at link.ld's __stack_top, for crt0s that do not set it.
+  reg[_sp] = MEM_SIZE - 0x1000;
+  symValue("__stack_top", &reg[_sp]);
+#ifdef CALL_PROF
+  callprofReset(pc);
+#endif
+#ifdef CALL_TRACE
+  traceReset(pc);
+#endif
+#ifdef MEM_PROF
+  uint32_t stack_top = MEMPROF_STACK_TOP;
+  symValue("__stack_top", &stack_top);
+  memprofReset(MEM_SIZE, stack_top);
+#endif
+#ifdef HOST_PERF
+  hostperfReset();
+#endif
+#ifdef COVERAGE
+  covReset(MEM_SIZE);
+#endif
+#ifdef CACHE_SIM
+  cacheReset(MEM_SIZE);
+#endif
+#ifdef PIPE_MODEL
+  pipeReset();
+#endif
+#if defined(RECORD) || defined(REPLAY)
+  replayReset();
+#endif
+#ifdef TRAPS
+  trapReset();
+#endif
+#ifdef MMU
+  mmuReset(memory, MEM_SIZE);
+#endif
+#ifdef REVERSE
+  revReset(MEM_SIZE);
+  rev_target = REV_NONE;
+#endif
+#ifdef METRICS
+  metricsReset();
+#endif
+#ifdef NATIVE_LIB
+  char native_msg[40];
+  sprintf(native_msg, "native: %d routines", nativeReset());
+  termPuts(native_msg);
+#endif
 
   // Initialize output.
-  char out_str[40] = {0};
+  char out_str[64] = {0};  // Room for the longest (vector) disassembly.
   char* out_op = out_str + 18;
   sprintf(out_str, "Addr    Inst      Disassembly");
   decodePuts(out_str);
@@ -380,9 +1287,44 @@ reset:
     updateLEDs();
 
     // Check pause/continue, step, reset.
-    int keys = readKeys();
+    int keys = LIVE_INPUT(INPUT_KEYS, (uint32_t)readKeys());
     if (keys & 0b1000) goto reset;
-    if (f_exit) continue;
+#ifdef REVERSE
+    if (rev_target != REV_NONE) {  // Re-executing: hold the keys until there.
+      keys = 0;
+      f_pause = instret == rev_target;
+      if (f_pause) {
+        rev_target = REV_NONE;
+        sprintf(out_str, "back to 0x%-8x", pc);
+        termPuts(out_str);
+        updateCharBuf();
+      }
+    }
+    if (keys & 0b100) {  // Step back when paused, else back to last ebreak.
+      bool step = f_pause && !f_exit;
+      if (reverseTo(step ? instret - 1 : revLastBreak(instret))) continue;
+      sprintf(out_str, "no snapshot before 0x%-8x", pc);
+      termPuts(out_str);
+    }
+#endif
+#ifdef FUZZ
+    if (f_exit && fuzzEnd(f_fault)) {  // Persistent mode: next input.
+      fuzzRestore();
+      reg[_a0] = fuzzByte();
+      f_exit = false;
+    }
+#endif
+#ifdef BATCH
+    if (f_exit) return exit_code;
+#else
+    if (f_exit) {  // Wait for reset.
+      if (!idleWait()) return exit_code;
+      continue;
+    }
+#endif
+#ifdef METRICS
+    if (METRICS_DUE()) metricsUpdate(pc, instret, f_pause);
+#endif
     if (keys & 0b10) {
       f_pause = !f_pause;
       if (f_pause) sprintf(out_str, "paused at 0x%-8x", pc);
@@ -395,22 +1337,117 @@ reset:
       f_step = false;
       sprintf(out_str, "step to 0x%-8x", pc);
       termPuts(out_str);
-    } else if (f_pause)
+    } else if (f_pause) {
+      if (!idleWait()) {
+        sprintf(out_str, "paused with no key input");
+        termPuts(out_str);
+        return exit_code;
+      }
       continue;
+    }
 
-    if (pc >= MEM_SIZE) {
-      f_exit = true;
-      sprintf(out_str, "pc=0x%d out of memory bound", pc);
+#ifndef MMU  // Otherwise fetchMiss checks the physical address.
+    // A 32-bit instruction's upper half must be in memory too.
+    if (pc > MEM_SIZE - 2 ||
+        (pc > MEM_SIZE - 4 && !IS_RVC(MEM_HALF_U(pc)))) {
+#ifdef TRAPS
+      inst_pc = pc;
+      if (raiseException(CAUSE_FETCH_ACCESS, pc)) continue;
+#endif
+      f_exit = f_fault = true;
+      PROBE3(mem_fault, pc, pc, false);
+      sprintf(out_str, "pc=0x%x out of memory bound", pc);
       termPuts(out_str);
+      exitReport();
       updateCharBuf();
       continue;
     }
-    // Fetch new instruction and update pc.
-    uint32_t inst_u32 = MEM_WORD_U(pc);
-    sprintf(out_str, "%-8x%08x  ", pc, inst_u32);
-    pc += 4;
+#endif
+#ifdef TRAPS
+    if (f_wfi) {  // Idle until an enabled interrupt is pending.
+      uint64_t now = guestTime();
+      if (!trapPending(now)) {
+        uint64_t deadline = trapDeadline();
+        if (deadline == UINT64_MAX) {  // Nothing can wake this hart.
+          f_exit = true;
+          sprintf(out_str, "wfi with no interrupt enabled");
+          termPuts(out_str);
+          exitReport();
+          updateCharBuf();
+          continue;
+        }
+#ifdef VIRTUAL_TIME
+        trap.mtime_offset += deadline - now;  // Skip to the deadline.
+#elif !defined(REPLAY)
+        waitKeys(deadline - now < WFI_SLICE_US ? deadline - now : WFI_SLICE_US);
+#endif
+        continue;
+      }
+      f_wfi = false;
+      trap_poll_at = 0;
+    }
+    if (TRAP_DUE(instret)) {
+      trap_poll_at = instret + TRAP_POLL;
+      trapPending(guestTime());
+      uint32_t cause = trapInterrupt();
+      if (cause) pc = trapEnter(cause, 0, pc);
+    }
+#endif
+#ifdef PC_PROF
+    if (PCPROF_DUE()) pcprofSample(pc);
+#endif
+#ifdef REVERSE
+    if (REV_DUE(instret)) reverseSnapshot();
+#endif
+    // Fetch new instruction and update pc. Compressed instructions are
+    // expanded to their 32-bit form, so the decoder below only sees RV32I.
+    inst_pc = pc;
+#ifdef MMU
+    if (MMU_HIT(pc, 2, ACC_FETCH) && (pc & MMU_PAGE_MASK) != MMU_PAGE - 2) {
+      inst_pa = MMU_PA(pc);
+      inst_pa_hi = inst_pa + 2;
+    } else if (!fetchMiss(out_op)) {
+      if (f_exit) {
+        termPuts(out_op);
+        exitReport();
+        updateCharBuf();
+      }
+      continue;
+    }
+#endif
+#ifdef COVERAGE
+    COV_EXEC(inst_pa);
+#endif
+    uint32_t inst_u32;
+    uint16_t inst_lo = MEM_HALF_U(inst_pa);
+    if (IS_RVC(inst_lo)) {
+      inst_u32 = RVC_EXPAND(inst_lo);
+      sprintf(out_str, "%-8x    %04x  ", inst_pc, inst_lo);
+      pc += 2;
+    } else {
+#ifdef MMU
+      inst_u32 = inst_lo | (uint32_t)MEM_HALF_U(inst_pa_hi) << 16;
+#else
+      inst_u32 = MEM_WORD_U(inst_pa);
+#endif
+      sprintf(out_str, "%-8x%08x  ", inst_pc, inst_u32);
+      pc += 4;
+    }
+#ifdef CACHE_SIM
+    if (!cacheFetch(inst_pa, pc - inst_pc == 4 ? inst_pa_hi : inst_pa,
+                    inst_pc))
+      PIPE_MISS();
+#endif
+#ifdef PIPE_MODEL
+    uint32_t pipe_fall = pc;
+#endif
 
+#ifdef HOST_PERF
+    bool hostperf_due = HOSTPERF_DUE();
+    if (hostperf_due) hostperfBegin();
+#endif
     // Decode new instruction.
+    f_invalid = false;
     InstField *inst = (InstField *)&inst_u32;
     switch (OPCODE(inst_u32)) {
       case U_LUI:
@@ -418,21 +1455,32 @@ reset:
         sprintf(out_op, "lui x%d, 0x%x", inst->U.rd, inst->U.imm31_12);
         break;
       case U_AUIPC:
-        reg[inst->U.rd] = pc - 4 + (inst->U.imm31_12 << 12);
+        reg[inst->U.rd] = inst_pc + (inst->U.imm31_12 << 12);
         sprintf(out_op, "auipc x%d, 0x%x", inst->U.rd, inst->U.imm31_12);
         break;
       case J_JAL:
         reg[inst->J.rd] = pc;
-        pc += ((-inst->J.imm20 << 20) | (inst->J.imm19_12 << 12) |
-               (inst->J.imm11 << 11) | (inst->J.imm10_1 << 1)) - 4;
+        pc = inst_pc + ((-inst->J.imm20 << 20) | (inst->J.imm19_12 << 12) |
+                        (inst->J.imm11 << 11) | (inst->J.imm10_1 << 1));
         sprintf(out_op, "jal x%d, 0x%x", inst->J.rd, pc);
+        if (IS_LINK(inst->J.rd)) guestCall(pc, reg[inst->J.rd]);
+#ifdef FUZZ
+        FUZZ_EDGE(pc);
+#endif
         break;
-      case Is_JALR:
-        reg[inst->Is.rd] = pc;
-        pc = (-2) & (reg[inst->Is.rs1] + inst->Is.imm11_0);
+      case Is_JALR: {
+        uint32_t tgt = (-2) & (reg[inst->Is.rs1] + inst->Is.imm11_0);
+        reg[inst->Is.rd] = pc;  // After reading rs1, which may equal rd.
+        pc = tgt;
         sprintf(out_op, "jalr x%d, x%d, %d",
                inst->Is.rd, inst->Is.rs1, inst->Is.imm11_0);
+        if (IS_LINK(inst->Is.rd)) guestCall(pc, reg[inst->Is.rd]);
+        else if (inst->Is.rd == _zero && IS_LINK(inst->Is.rs1)) guestReturn(pc);
+#ifdef FUZZ
+        FUZZ_EDGE(pc);
+#endif
         break;
+      }
       case B_Branch:
         handleBranch(inst, out_op);
         break;
@@ -448,28 +1496,76 @@ reset:
       case R_Op:
         handleOp(inst, out_op);
          break;
-      case I_MiscMem:
-        sprintf(out_op, "unsupported misc-mem");
-        break;
-      case Iu_System:
-        if (inst->Iu.imm11_0 == 0x0) {
-          sprintf(out_op, "ecall (%d)", reg[_a0]);
-          f_ecall = true;
+      case I_MiscMem:  // Memory is coherent: FENCE and FENCE.I do nothing.
+        if (inst->Is.funct3 > 0b001) {
+          sprintf(out_op, "unknown misc-mem");
+          illegalInst(inst_u32);
         } else {
-          sprintf(out_op, "ebreak");
-          f_pause = true;
+          sprintf(out_op, inst->Is.funct3 ? "fence.i" : "fence");
         }
         break;
+      case I_LoadFp:
+      case S_StoreFp: {
+        uint32_t addr;
+#ifdef MMU
+        uint32_t base = reg[inst->Is.rs1];
+        if (!translateFpVec(inst_u32, out_op)) break;
+#endif
+        enum FpMemStatus st = VEC_WIDTH(inst->Is.funct3)
+            ? vecLoadStore(inst_u32, reg, memory, MEM_SIZE, &addr, out_op)
+            : fpuLoadStore(inst_u32, reg, memory, MEM_SIZE, &addr, out_op);
+#ifdef MMU
+        reg[inst->Is.rs1] = base;
+#endif
+        if (st == FP_MEM_FAULT)
+          memFault(addr, (OPCODE(inst_u32)) == S_StoreFp, out_op);
+        else if (st == FP_MEM_ILLEGAL)
+          illegalInst(inst_u32);
+        break;
+      }
+      case R_OpFp:
+      case R4_FMadd:
+      case R4_FMsub:
+      case R4_FNMsub:
+      case R4_FNMadd:
+        if (!fpuOp(inst_u32, reg, out_op)) illegalInst(inst_u32);
+        break;
+      case V_Op:
+        if (!vecOp(inst_u32, reg, out_op)) illegalInst(inst_u32);
+        break;
+      case Iu_System:
+        handleSystem(inst, out_op);
+        break;
       default:
         sprintf(out_op, "unknown");
+        illegalInst(inst_u32);
         break;
     }
+#ifdef HOST_PERF
+    if (hostperf_due) hostperfEnd(inst_pc, f_invalid ? NULL : out_op);
+#endif
 
     reg[_zero] = 0; // Reset x0 (hard zero).
+#ifdef MEM_PROF
+    MEMPROF_SP(reg[_sp]);
+#endif
+    PROBE3(retire, inst_pc, inst_u32, instret);
+    ++instret;
+#ifdef PIPE_MODEL
+    cycle += pipeRetire(inst_u32, inst_pc, pipe_fall, pc);
+#else
+    ++cycle;
+#endif
+#ifdef INST_HIST
+    histCount(f_invalid ? NULL : out_op);
+#endif
     // Update outputs.
+#ifndef BATCH
     decodePuts(out_str);
     updateReg(pc, reg);
+#endif
     if (f_ecall) handleEcall();  // Deal with ecalls.
+    if (f_exit) exitReport();
     updateCharBuf();
   }
   return 1; // Terminate if pc out of memory bound.
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memprof.h"
+
+uint32_t* memprof_loads = NULL;
+uint32_t* memprof_stores = NULL;
+uint32_t memprof_blocks = 0;
+uint32_t memprof_stack_top = 0;
+uint32_t memprof_min_sp = 0;
+uint64_t memprof_outside = 0;  // Accesses beyond guest memory.
+
+void memprofReset(uint32_t mem_size, uint32_t stack_top) {
+  memprof_blocks = mem_size >> MEMPROF_SHIFT;
+  free(memprof_loads);
+  free(memprof_stores);
+  memprof_loads = calloc(memprof_blocks, sizeof(uint32_t));
+  memprof_stores = calloc(memprof_blocks, sizeof(uint32_t));
+  if (!memprof_loads || !memprof_stores) memprof_blocks = 0;
+  memprof_stack_top = memprof_min_sp = stack_top;
+  memprof_outside = 0;
+}
+
+void memprofLoad(uint32_t addr) {
+  if ((addr >> MEMPROF_SHIFT) < memprof_blocks)
+    ++memprof_loads[addr >> MEMPROF_SHIFT];
+  else
+    ++memprof_outside;
+}
+
+void memprofStore(uint32_t addr) {
+  if ((addr >> MEMPROF_SHIFT) < memprof_blocks)
+    ++memprof_stores[addr >> MEMPROF_SHIFT];
+  else
+    ++memprof_outside;
+}
+
+int memprofCmp(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  uint64_t cx = (uint64_t)memprof_loads[x] + memprof_stores[x];
+  uint64_t cy = (uint64_t)memprof_loads[y] + memprof_stores[y];
+  return (cx < cy) - (cx > cy);  // Descending.
+}
+
+void memprofDump() {
+  if (!memprof_blocks) return;
+  uint64_t ld[2] = {0}, st[2] = {0};  // [0] data/heap, [1] stack.
+  uint32_t* hot = malloc(memprof_blocks * sizeof(uint32_t));
+  uint32_t n = 0;
+
+  FILE* f = fopen(MEMPROF_FILE, "w");
+  if (f) fprintf(f, "addr,loads,stores,region\n");
+  for (uint32_t b = 0; b < memprof_blocks; ++b) {
+    if (!memprof_loads[b] && !memprof_stores[b]) continue;
+    uint32_t lo = b << MEMPROF_SHIFT, hi = lo + (1u << MEMPROF_SHIFT);
+    int stack = hi > memprof_min_sp && lo < memprof_stack_top;
+    ld[stack] += memprof_loads[b];
+    st[stack] += memprof_stores[b];
+    if (hot) hot[n++] = b;
+    if (f) fprintf(f, "0x%x,%u,%u,%s\n", b << MEMPROF_SHIFT, memprof_loads[b],
+                   memprof_stores[b], stack ? "stack" : "data");
+  }
+  if (f) fclose(f);
+
+  printf("\nMemory profile (%u-byte blocks)\n", 1u << MEMPROF_SHIFT);
+  printf("%-10s %12s %12s\n", "region", "loads", "stores");
+  printf("%-10s %12llu %12llu\n", "stack", (unsigned long long)ld[1],
+         (unsigned long long)st[1]);
+  printf("%-10s %12llu %12llu\n", "data/heap", (unsigned long long)ld[0],
+         (unsigned long long)st[0]);
+  if (memprof_outside)
+    printf("%llu accesses outside guest memory\n",
+           (unsigned long long)memprof_outside);
+  printf("Stack high-water: sp=0x%x, %u bytes below 0x%x\n", memprof_min_sp,
+         memprof_stack_top - memprof_min_sp, memprof_stack_top);
+
+  if (hot) {
+    qsort(hot, n, sizeof(uint32_t), memprofCmp);
+    printf("%-10s %12s %12s\n", "hot block", "loads", "stores");
+    for (uint32_t i = 0; i < n && i < MEMPROF_TOP; ++i) {
+      printf("0x%-8x %12u %12u\n", hot[i] << MEMPROF_SHIFT,
+             memprof_loads[hot[i]], memprof_stores[hot[i]]);
+    }
+    free(hot);
+  }
+  if (f) printf("Heatmap written to %s\n", MEMPROF_FILE);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// Guest memory-access profiler, enabled with -DMEM_PROF.
+// Counts loads and stores per 2^MEMPROF_SHIFT byte block (64 B cache lines by
+// default, 12 for 4 KiB pages), tracks the lowest sp reached, and splits
+// traffic between the stack (below __stack_top) and everything else.
+
+#ifndef MEMPROF_SHIFT
+#define MEMPROF_SHIFT 6
+#endif
+#ifndef MEMPROF_TOP
+#define MEMPROF_TOP 16      // Hot blocks listed at exit.
+#endif
+#ifndef MEMPROF_STACK_TOP
+#define MEMPROF_STACK_TOP 0xFF000  // Default __stack_top in link.ld.
+#endif
+#ifndef MEMPROF_FILE
+#define MEMPROF_FILE "memprof.csv"  // Heatmap: block address, loads, stores.
+#endif
+
+extern uint32_t memprof_min_sp;
+
+// Track the stack high-water mark; sp is 0 until the guest sets it up.
+#define MEMPROF_SP(sp) \
+  if ((sp) && (sp) < memprof_min_sp) memprof_min_sp = (sp)
+
+// Start a new profile of mem_size bytes of guest memory.
+void memprofReset(uint32_t mem_size, uint32_t stack_top);
+
+void memprofLoad(uint32_t addr);
+
+void memprofStore(uint32_t addr);
+
+// Print the summary and hot blocks and write the heatmap file.
+void memprofDump();
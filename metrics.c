@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef __NIOS2__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "io.h"
+#include "metrics.h"
+
+MetricsPage* metrics = NULL;
+uint32_t metrics_countdown = METRICS_INTERVAL;
+uint64_t metrics_last_inst = 0, metrics_last_us = 0;
+#ifndef __NIOS2__
+char metrics_name[32];
+pid_t metrics_owner;  // Process that created the segment.
+#endif
+
+// Seqlock writer side.
+void metricsBegin() {
+  __atomic_store_n(&metrics->seq, metrics->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void metricsEnd() {
+  __atomic_store_n(&metrics->seq, metrics->seq + 1, __ATOMIC_RELEASE);
+}
+
+#ifndef __NIOS2__
+// Remove the segment name at exit. Monitors that have the page mapped keep
+// the final state; forked fuzz children leave it to the creator.
+void metricsUnlink() {
+  if (getpid() == metrics_owner) shm_unlink(metrics_name);
+}
+#endif
+
+void metricsReset() {
+#ifndef __NIOS2__
+  if (!metrics) {
+    sprintf(metrics_name, "/rvemu.%d", (int)getpid());
+    int fd = shm_open(metrics_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd != -1) {
+      if (ftruncate(fd, sizeof(MetricsPage)) == 0) {
+        void* p = mmap(NULL, sizeof(MetricsPage), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) metrics = p;
+      }
+      close(fd);
+      if (metrics) {
+        metrics_owner = getpid();
+        atexit(metricsUnlink);
+      } else {
+        shm_unlink(metrics_name);
+      }
+    }
+    if (metrics) printf("metrics: /dev/shm%s\n", metrics_name);
+    else printf("metrics: shared memory unavailable\n");
+  }
+#endif
+  metrics_countdown = METRICS_INTERVAL;
+  metrics_last_inst = 0;
+  metrics_last_us = readTimeUs();
+  if (!metrics) return;
+  metricsBegin();
+  uint32_t seq = metrics->seq;
+  memset((char*)metrics + sizeof(uint32_t) * 3, 0,
+         sizeof(MetricsPage) - sizeof(uint32_t) * 3);
+  metrics->magic = METRICS_MAGIC;
+  metrics->version = METRICS_VERSION;
+  metrics->seq = seq;
+#ifndef __NIOS2__
+  metrics->pid = getpid();
+#endif
+  metrics->update_us = metrics_last_us;
+  metricsEnd();
+}
+
+void metricsUpdate(uint32_t pc, uint64_t instret, int paused) {
+  metrics_countdown = METRICS_INTERVAL;
+  if (!metrics) return;
+  uint64_t now = readTimeUs();
+  metricsBegin();
+  if (now > metrics_last_us) {
+    metrics->mips_milli = (instret - metrics_last_inst) * 1000 / (now - metrics_last_us);
+  }
+  metrics->update_us = now;
+  metrics->instret = instret;
+  metrics->pc = pc;
+  metrics->state = paused ? MS_PAUSED : MS_RUNNING;
+  metricsEnd();
+  metrics_last_inst = instret;
+  metrics_last_us = now;
+}
+
+void metricsEcall(uint32_t num) {
+  if (!metrics) return;
+  metricsBegin();
+  ++metrics->ecalls[num < METRICS_ECALLS ? num : METRICS_ECALLS - 1];
+  metricsEnd();
+}
+
+void metricsExit(uint32_t pc, uint64_t instret, int32_t code) {
+  metricsUpdate(pc, instret, 0);
+  if (!metrics) return;
+  metricsBegin();
+  metrics->mips_milli = 0;
+  metrics->state = MS_EXITED;
+  metrics->exit_code = code;
+  metricsEnd();
+}
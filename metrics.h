@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+// Live metrics in a POSIX shared-memory page, enabled with -DMETRICS (host
+// only). The segment is /dev/shm/rvemu.<pid>. Monitors map it read-only and
+// poll it without syscalls. Retry while seq is odd or changed across the read
+// (seqlock). Bump METRICS_VERSION on any layout change. The name is unlinked
+// when the emulator exits normally; a monitor that wants the final state
+// must have the page mapped by then. After a crash or kill, remove stale
+// segments with rm /dev/shm/rvemu.<pid>.
+
+#define METRICS_MAGIC 0x54535652  // "RVST"
+#define METRICS_VERSION 1
+#define METRICS_ECALLS 2048       // Ecall numbers >= this count in the last slot.
+
+#ifndef METRICS_INTERVAL
+#define METRICS_INTERVAL 65536    // Loop iterations between updates.
+#endif
+
+enum MetricsState { MS_RUNNING, MS_PAUSED, MS_EXITED };
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t seq;         // Odd while the emulator is writing.
+  uint32_t pid;
+  uint64_t update_us;   // Host time of the last update.
+  uint64_t instret;     // Instructions retired since reset.
+  uint64_t mips_milli;  // Emulated MIPS x 1000 over the last interval.
+  uint32_t pc;
+  uint32_t state;       // MetricsState.
+  int32_t exit_code;    // Valid once state is MS_EXITED.
+  uint32_t reserved;
+  uint64_t ecalls[METRICS_ECALLS];  // Count per ecall number: a7 for
+                                    // newlib calls, else a0.
+} MetricsPage;
+
+extern uint32_t metrics_countdown;
+
+#define METRICS_DUE() (--metrics_countdown == 0)
+
+// Map the page (once) and clear it.
+void metricsReset();
+
+void metricsUpdate(uint32_t pc, uint64_t instret, int paused);
+
+void metricsEcall(uint32_t num);
+
+void metricsExit(uint32_t pc, uint64_t instret, int32_t code);
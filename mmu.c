@@ -0,0 +1,145 @@
+#include "mmu.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Sv32 PTE bits.
+#define PTE_V (1u << 0)
+#define PTE_R (1u << 1)
+#define PTE_W (1u << 2)
+#define PTE_X (1u << 3)
+#define PTE_U (1u << 4)
+#define PTE_A (1u << 6)
+#define PTE_D (1u << 7)
+
+enum MmuLevel { TLB_U, TLB_S, TLB_M };
+
+MmuTlbEntry mmu_tlbs[3][MMU_TLB_SIZE];
+MmuTlbEntry *mmu_tlb = mmu_tlbs[TLB_M];
+
+uint8_t *mmu_mem = NULL;
+uint32_t mmu_mem_size = 0;
+uint32_t mmu_satp = 0, mmu_mstatus = 0;  // Context the TLBs were filled in.
+bool mmu_mega = false;  // A megapage is cached: single-page fences flush all.
+
+uint64_t mmu_walks = 0, mmu_faults = 0, mmu_flushes = 0;
+
+void mmuFlushTlb(int level) {
+  memset(mmu_tlbs[level], 0xff, sizeof(mmu_tlbs[level]));
+}
+
+void mmuFlushPaged() {
+  mmuFlushTlb(TLB_U);
+  mmuFlushTlb(TLB_S);
+  mmu_mega = false;
+  ++mmu_flushes;
+}
+
+void mmuFlush() {
+  mmuFlushPaged();
+  mmuFlushTlb(TLB_M);
+  mmu_satp = trap.satp;
+  mmu_mstatus = trap.mstatus;
+  mmuContext();
+}
+
+void mmuReset(uint8_t *mem, uint32_t mem_size) {
+  mmu_mem = mem;
+  mmu_mem_size = mem_size;
+  mmu_walks = mmu_faults = mmu_flushes = 0;
+  mmuFlush();
+}
+
+void mmuContext() {
+  uint32_t changed = (trap.mstatus ^ mmu_mstatus) & (MSTATUS_SUM | MSTATUS_MXR);
+  if (trap.satp != mmu_satp || (changed & MSTATUS_MXR)) {
+    mmuFlushPaged();
+  } else if (changed & MSTATUS_SUM) {
+    mmuFlushTlb(TLB_S);
+    ++mmu_flushes;
+  }
+  mmu_satp = trap.satp;
+  mmu_mstatus = trap.mstatus;
+  mmu_tlb = mmu_tlbs[trap.priv == PRIV_M ? TLB_M : trap.priv];
+}
+
+void mmuFence(uint32_t va, bool all) {
+  if (all || mmu_mega) {
+    mmuFlushPaged();
+    return;
+  }
+  uint32_t i = (va >> MMU_PAGE_SHIFT) & (MMU_TLB_SIZE - 1);
+  memset(&mmu_tlbs[TLB_U][i], 0xff, sizeof(MmuTlbEntry));
+  memset(&mmu_tlbs[TLB_S][i], 0xff, sizeof(MmuTlbEntry));
+}
+
+// Cache the page of va at physical page pa for the allowed access types.
+void mmuFill(uint32_t va, uint32_t pa, bool load, bool store, bool fetch) {
+  if (pa > mmu_mem_size - MMU_PAGE) return;  // Not RAM.
+  MmuTlbEntry *e = MMU_ENTRY(va);
+  uint32_t page = va & ~MMU_PAGE_MASK;
+  e->tag[ACC_LOAD] = load ? page : MMU_TLB_INVALID;
+  e->tag[ACC_STORE] = store ? page : MMU_TLB_INVALID;
+  e->tag[ACC_FETCH] = fetch ? page : MMU_TLB_INVALID;
+  e->pa = pa;
+}
+
+uint32_t mmuTranslate(uint32_t va, int acc, uint32_t *pa) {
+  static const uint32_t page_fault[3] = {
+    CAUSE_LOAD_PAGE_FAULT, CAUSE_STORE_PAGE_FAULT, CAUSE_FETCH_PAGE_FAULT};
+  static const uint32_t access_fault[3] = {
+    CAUSE_LOAD_ACCESS, CAUSE_STORE_ACCESS, CAUSE_FETCH_ACCESS};
+  if (!MMU_PAGING()) {
+    *pa = va;
+    mmuFill(va, va & ~MMU_PAGE_MASK, true, true, true);
+    return 0;
+  }
+  ++mmu_walks;
+  uint64_t table = (uint64_t)(trap.satp & SATP_PPN) << MMU_PAGE_SHIFT;
+  uint32_t pte, pte_addr;
+  int level = 1;
+  while (true) {
+    uint64_t a = table + ((va >> (MMU_PAGE_SHIFT + 10 * level)) & 0x3ff) * 4;
+    if (a > mmu_mem_size - 4) return access_fault[acc];
+    pte_addr = a;
+    memcpy(&pte, &mmu_mem[pte_addr], 4);
+    if (!(pte & PTE_V) || ((pte & PTE_W) && !(pte & PTE_R))) goto fault;
+    if (pte & (PTE_R | PTE_X)) break;  // Leaf.
+    if (level-- == 0) goto fault;
+    table = (uint64_t)(pte >> 10) << MMU_PAGE_SHIFT;
+  }
+  // Leaf: permissions for the current mode.
+  bool user = pte & PTE_U;
+  bool data_ok = trap.priv == PRIV_U ? user
+                 : !user || (trap.mstatus & MSTATUS_SUM);
+  bool fetch_ok = (trap.priv == PRIV_U) == user && (pte & PTE_X);
+  bool load_ok = data_ok && ((pte & PTE_R) ||
+                             ((trap.mstatus & MSTATUS_MXR) && (pte & PTE_X)));
+  bool store_ok = data_ok && (pte & PTE_W);
+  if (!(acc == ACC_LOAD ? load_ok : acc == ACC_STORE ? store_ok : fetch_ok))
+    goto fault;
+  uint64_t base = (uint64_t)(pte >> 10) << MMU_PAGE_SHIFT;
+  if (level) {  // 4 MiB megapage: PPN[0] must be zero.
+    if ((pte >> 10) & 0x3ff) goto fault;
+    base |= va & (0x3ffu << MMU_PAGE_SHIFT);
+    mmu_mega = true;
+  }
+  if (base >> 32) return access_fault[acc];
+  uint32_t update = PTE_A | (acc == ACC_STORE ? PTE_D : 0);
+  if ((pte & update) != update) {
+    pte |= update;
+    memcpy(&mmu_mem[pte_addr], &pte, 4);
+  }
+  *pa = (uint32_t)base | (va & MMU_PAGE_MASK);
+  mmuFill(va, base, load_ok, store_ok && (pte & PTE_D), fetch_ok);
+  return 0;
+fault:
+  ++mmu_faults;
+  return page_fault[acc];
+}
+
+void mmuDump() {
+  printf("mmu: %llu page walks, %llu page faults, %llu flushes\n",
+         (unsigned long long)mmu_walks, (unsigned long long)mmu_faults,
+         (unsigned long long)mmu_flushes);
+}
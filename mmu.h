@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "trap.h"
+
+// Sv32 virtual memory for S- and U-mode, enabled with -DMMU (implies
+// -DTRAPS). Every load, store and fetch goes through a direct-mapped
+// software TLB, one per privilege level so traps between levels need no
+// flush. An entry tags its virtual page once per access type it permits
+// (load, store, fetch), so a hit is one mask and compare: the permission
+// check is folded into the tag and misaligned accesses always miss. The
+// entry holds the physical page, whose host address is memory + pa. On a
+// miss the page table is walked and A/D are set in the PTE; a store only
+// fills the TLB for writing once D is set. M-mode and Bare satp map
+// identity pages through the same TLB. Only RAM pages are cached, so IO
+// (CLINT) accesses walk each time.
+//
+// Invalidation is precise: SFENCE.VMA with rs1 drops the one entry for
+// that page (all of them if a 4 MiB megapage is cached), satp writes flush
+// only when satp changes, SUM only affects the S-mode TLB.
+
+#define MMU_PAGE_SHIFT 12
+#define MMU_PAGE (1u << MMU_PAGE_SHIFT)
+#define MMU_PAGE_MASK (MMU_PAGE - 1)
+#ifndef MMU_TLB_SIZE
+#define MMU_TLB_SIZE 256  // Entries per privilege level, power of two.
+#endif
+#define MMU_TLB_INVALID UINT32_MAX  // Never equals a masked address.
+
+enum MmuAccess { ACC_LOAD, ACC_STORE, ACC_FETCH };
+
+typedef struct {
+  uint32_t tag[3];  // Virtual page per MmuAccess, or MMU_TLB_INVALID.
+  uint32_t pa;      // Physical page.
+} MmuTlbEntry;
+
+extern MmuTlbEntry *mmu_tlb;  // TLB of the current privilege level.
+
+#define MMU_ENTRY(va) (&mmu_tlb[((va) >> MMU_PAGE_SHIFT) & (MMU_TLB_SIZE - 1)])
+// A width-byte (power of two) access of type acc at va hits the TLB.
+#define MMU_HIT(va, width, acc) \
+  (MMU_ENTRY(va)->tag[acc] == ((va) & ~(MMU_PAGE_MASK & ~((width) - 1))))
+// Physical address of va after a hit.
+#define MMU_PA(va) (MMU_ENTRY(va)->pa | ((va) & MMU_PAGE_MASK))
+
+// Translation is on: S- or U-mode with Sv32 in satp.
+#define MMU_PAGING() (trap.priv != PRIV_M && (trap.satp & SATP_MODE))
+
+// Flush everything; mem and mem_size are guest physical memory.
+void mmuReset(uint8_t *mem, uint32_t mem_size);
+
+// Flush everything, after trap state or memory was restored.
+void mmuFlush();
+
+// Follow a change of privilege level, satp or mstatus SUM/MXR.
+void mmuContext();
+
+// SFENCE.VMA: drop the translation of va, or all of them if all.
+void mmuFence(uint32_t va, bool all);
+
+// Translate va for an access of type acc, filling the TLB for RAM pages.
+// Returns 0 with the physical address in pa, or the trap cause: a page
+// fault, or an access fault if the page table is outside memory.
+uint32_t mmuTranslate(uint32_t va, int acc, uint32_t *pa);
+
+void mmuDump();
@@ -0,0 +1,184 @@
+#include "native.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sym.h"
+
+// Registers.
+#define SP 2
+#define A0 10
+#define A1 11
+#define A2 12
+
+enum NativeFn { N_MEMCPY, N_MEMSET, N_MEMMOVE, N_STRLEN, N_STRCMP, N_NUM };
+
+typedef struct {
+  const char* name;
+  bool hooked;
+  uint32_t addr;
+  uint64_t calls;     // Run on the host (or verified, with NATIVE_VERIFY).
+  uint64_t mismatch;  // NATIVE_VERIFY: guest and host results differ.
+} NativeRoutine;
+
+NativeRoutine native[N_NUM] = {
+  {"memcpy"}, {"memset"}, {"memmove"}, {"strlen"}, {"strcmp"},
+};
+
+#ifdef NATIVE_VERIFY
+// Host result of the guest routine currently running.
+struct {
+  int fn;  // N_NUM if none.
+  uint32_t ret, sp;
+  uint32_t a0;  // Return value (strcmp: its sign).
+  uint32_t dst, len;
+  uint8_t bytes[NATIVE_VERIFY_MAX];
+} native_pending = {N_NUM};
+#endif
+
+// True if name is an entry of the comma-separated allow-list.
+bool nativeAllowed(const char* name) {
+  static const char allow[] = NATIVE_ALLOW;
+  size_t n = strlen(name);
+  for (const char* p = allow; (p = strstr(p, name)); p += n) {
+    if ((p == allow || p[-1] == ',') && (p[n] == ',' || !p[n]))
+      return true;
+  }
+  return false;
+}
+
+int nativeReset() {
+  int n = 0;
+  for (int i = 0; i < N_NUM; ++i) {
+    native[i].calls = native[i].mismatch = 0;
+    native[i].hooked = nativeAllowed(native[i].name) &&
+                       symValue(native[i].name, &native[i].addr);
+    n += native[i].hooked;
+  }
+#ifdef NATIVE_VERIFY
+  native_pending.fn = N_NUM;
+#endif
+  return n;
+}
+
+// True if [addr, addr + len) lies inside guest memory.
+bool nativeRange(uint32_t addr, uint32_t len, uint32_t mem_size) {
+  return len <= mem_size && addr <= mem_size - len;
+}
+
+// True if a NUL-terminated string starts at addr inside guest memory.
+bool nativeString(uint32_t addr, uint8_t *mem, uint32_t mem_size) {
+  return addr < mem_size && memchr(&mem[addr], 0, mem_size - addr);
+}
+
+// Sign of a strcmp result.
+int32_t nativeSign(int32_t v) { return (v > 0) - (v < 0); }
+
+bool nativeCall(uint32_t target, uint32_t ret, uint32_t *x, uint8_t *mem,
+                uint32_t mem_size) {
+  int fn = 0;
+  while (fn < N_NUM && !(native[fn].hooked && native[fn].addr == target)) ++fn;
+  if (fn == N_NUM) return false;
+
+  uint32_t a0 = x[A0], a1 = x[A1], a2 = x[A2];
+  switch (fn) {
+    case N_MEMCPY:
+    case N_MEMMOVE:
+      if (!nativeRange(a0, a2, mem_size) || !nativeRange(a1, a2, mem_size))
+        return false;
+      break;
+    case N_MEMSET:
+      if (!nativeRange(a0, a2, mem_size)) return false;
+      break;
+    case N_STRLEN:
+      if (!nativeString(a0, mem, mem_size)) return false;
+      break;
+    case N_STRCMP:
+      if (!nativeString(a0, mem, mem_size) || !nativeString(a1, mem, mem_size))
+        return false;
+      break;
+  }
+  ++native[fn].calls;
+
+#ifdef NATIVE_VERIFY
+  // Let the guest code run; remember what the host would have produced.
+  if (native_pending.fn != N_NUM) return false;  // Nested call: unchecked.
+  native_pending.fn = fn;
+  native_pending.ret = ret;
+  native_pending.sp = x[SP];
+  native_pending.a0 = a0;
+  native_pending.dst = a0;
+  native_pending.len = 0;
+  switch (fn) {
+    case N_MEMCPY:
+    case N_MEMMOVE:
+      native_pending.len = a2 < NATIVE_VERIFY_MAX ? a2 : NATIVE_VERIFY_MAX;
+      memcpy(native_pending.bytes, &mem[a1], native_pending.len);
+      break;
+    case N_MEMSET:
+      native_pending.len = a2 < NATIVE_VERIFY_MAX ? a2 : NATIVE_VERIFY_MAX;
+      memset(native_pending.bytes, a1, native_pending.len);
+      break;
+    case N_STRLEN:
+      native_pending.a0 = strlen((char *)&mem[a0]);
+      break;
+    case N_STRCMP:
+      native_pending.a0 = nativeSign(strcmp((char *)&mem[a0], (char *)&mem[a1]));
+      break;
+  }
+  return false;
+#else
+  switch (fn) {
+    case N_MEMCPY:  // Overlap is undefined; memmove keeps it well-defined.
+    case N_MEMMOVE:
+      memmove(&mem[a0], &mem[a1], a2);
+      break;
+    case N_MEMSET:
+      memset(&mem[a0], a1, a2);
+      break;
+    case N_STRLEN:
+      x[A0] = strlen((char *)&mem[a0]);
+      break;
+    case N_STRCMP:
+      x[A0] = strcmp((char *)&mem[a0], (char *)&mem[a1]);
+      break;
+  }
+  return true;
+#endif
+}
+
+void nativeReturn(uint32_t target, uint32_t *x, uint8_t *mem) {
+#ifdef NATIVE_VERIFY
+  int fn = native_pending.fn;
+  if (fn == N_NUM || target != native_pending.ret || x[SP] != native_pending.sp)
+    return;
+  native_pending.fn = N_NUM;
+  uint32_t a0 = fn == N_STRCMP ? nativeSign(x[A0]) : x[A0];
+  if (a0 != native_pending.a0 ||
+      memcmp(&mem[native_pending.dst], native_pending.bytes, native_pending.len)) {
+    ++native[fn].mismatch;
+    printf("native: %s mismatch returning to 0x%x (a0 0x%x, host 0x%x)\n",
+           native[fn].name, target, x[A0], native_pending.a0);
+  }
+#else
+  (void)target, (void)x, (void)mem;
+#endif
+}
+
+void nativeDump() {
+  printf("\nNative routines (%s)\n", NATIVE_ALLOW);
+  printf("%-10s %-10s %12s", "routine", "addr", "calls");
+#ifdef NATIVE_VERIFY
+  printf(" %10s", "mismatch");
+#endif
+  printf("\n");
+  for (int i = 0; i < N_NUM; ++i) {
+    if (!native[i].hooked) continue;
+    printf("%-10s 0x%-8x %12llu", native[i].name, native[i].addr,
+           (unsigned long long)native[i].calls);
+#ifdef NATIVE_VERIFY
+    printf(" %10llu", (unsigned long long)native[i].mismatch);
+#endif
+    printf("\n");
+  }
+}
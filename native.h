@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Host-native guest library routines, enabled with -DNATIVE_LIB.
+// Calls (through a link register) to the allow-listed symbols below run as
+// host memcpy/memset/memmove/strlen/strcmp on memory[] and return to the
+// caller, costing one instruction. Calls whose arguments fall outside guest
+// memory run the guest code instead. Needs an ELF with its symbol table.
+//
+// With -DNATIVE_VERIFY the guest code always runs; its result is compared
+// with the host routine's when it returns, and mismatches are reported.
+
+#ifndef NATIVE_ALLOW
+#define NATIVE_ALLOW "memcpy,memset,memmove,strlen,strcmp"
+#endif
+#ifndef NATIVE_VERIFY_MAX
+#define NATIVE_VERIFY_MAX 4096  // Largest memory result checked, in bytes.
+#endif
+
+// Resolve the allow-listed symbols in the loaded ELF. Returns how many
+// routines are intercepted.
+int nativeReset();
+
+// Guest called target, to return to ret. x is the scalar register file.
+// Returns true if the routine ran on the host; the guest then continues at ret.
+bool nativeCall(uint32_t target, uint32_t ret, uint32_t *x, uint8_t *mem,
+                uint32_t mem_size);
+
+// Guest returned to target (NATIVE_VERIFY: check a pending guest routine).
+void nativeReturn(uint32_t target, uint32_t *x, uint8_t *mem);
+
+// Print calls per routine (and verification mismatches).
+void nativeDump();
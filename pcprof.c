@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(PROF_TIMER_US) && !defined(__NIOS2__)
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#include "pcprof.h"
+#include "sym.h"
+
+volatile int pcprof_tick = 0;
+uint32_t pcprof_countdown = PROF_INTERVAL;
+
+#define PCPROF_UNKNOWN SYM_MAX  // Function id for pcs without a symbol.
+#define PCPROF_ROOT (-1)        // Function id of the tree root.
+
+uint64_t pcprof_samples[SYM_MAX + 1];  // Last slot counts unknown pcs.
+uint64_t pcprof_total = 0;
+
+// Calling-context tree node: samples taken with this stack.
+typedef struct {
+  int func;
+  int parent, child, sibling;
+  uint64_t samples;
+} PcprofNode;
+
+PcprofNode pcprof_nodes[PROF_NODES];
+int pcprof_node_num = 0;
+int pcprof_stack[PROF_DEPTH];     // Node of each open call.
+uint32_t pcprof_ret[PROF_DEPTH];  // Its expected return address.
+int pcprof_depth = 0;
+int pcprof_lost = 0;  // Calls not tracked: stack or tree full.
+
+#if defined(PROF_TIMER_US) && !defined(__NIOS2__)
+void pcprofSignal(int sig) {
+  (void)sig;
+  pcprof_tick = 1;
+}
+#endif
+
+void pcprofReset() {
+  memset(pcprof_samples, 0, sizeof(pcprof_samples));
+  pcprof_total = 0;
+  pcprof_nodes[0].func = PCPROF_ROOT;
+  pcprof_nodes[0].parent = pcprof_nodes[0].child = pcprof_nodes[0].sibling = -1;
+  pcprof_nodes[0].samples = 0;
+  pcprof_node_num = 1;
+  pcprof_depth = pcprof_lost = 0;
+  pcprof_tick = 0;
+  pcprof_countdown = PROF_INTERVAL;
+#if defined(PROF_TIMER_US) && !defined(__NIOS2__)
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = pcprofSignal;
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGPROF, &sa, NULL);
+  struct itimerval it = {{0, PROF_TIMER_US}, {0, PROF_TIMER_US}};
+  setitimer(ITIMER_PROF, &it, NULL);
+#endif
+}
+
+int pcprofFunc(uint32_t addr) {
+  int i = symLookup(addr);
+  return i == SYM_NONE ? PCPROF_UNKNOWN : i;
+}
+
+// Node for func called from node parent, created on first use; parent
+// itself if the tree is full.
+int pcprofChild(int parent, int func) {
+  int n = pcprof_nodes[parent].child;
+  while (n != -1 && pcprof_nodes[n].func != func) n = pcprof_nodes[n].sibling;
+  if (n != -1) return n;
+  if (pcprof_node_num == PROF_NODES) {
+    ++pcprof_lost;
+    return parent;
+  }
+  n = pcprof_node_num++;
+  pcprof_nodes[n].func = func;
+  pcprof_nodes[n].parent = parent;
+  pcprof_nodes[n].child = -1;
+  pcprof_nodes[n].sibling = pcprof_nodes[parent].child;
+  pcprof_nodes[n].samples = 0;
+  pcprof_nodes[parent].child = n;
+  return n;
+}
+
+// Context of code in function func: the innermost open call, extended by
+// func if that is not the one running (the entry point, or a tail call).
+int pcprofContext(int func) {
+  int top = pcprof_depth ? pcprof_stack[pcprof_depth - 1] : 0;
+  return pcprof_nodes[top].func == func ? top : pcprofChild(top, func);
+}
+
+void pcprofCall(uint32_t from, uint32_t target, uint32_t ret) {
+  if (pcprof_depth == PROF_DEPTH) {
+    ++pcprof_lost;
+    return;
+  }
+  int caller = pcprofContext(pcprofFunc(from));
+  pcprof_stack[pcprof_depth] = pcprofChild(caller, pcprofFunc(target));
+  pcprof_ret[pcprof_depth++] = ret;
+}
+
+void pcprofReturn(uint32_t target) {
+  // Unwind to the call expecting this return address, if any.
+  int d = pcprof_depth;
+  while (d > 0 && pcprof_ret[d - 1] != target) --d;
+  if (d > 0) pcprof_depth = d - 1;
+}
+
+void pcprofSample(uint32_t pc) {
+  pcprof_tick = 0;
+  pcprof_countdown = PROF_INTERVAL;
+  int func = pcprofFunc(pc);
+  ++pcprof_samples[func];
+  ++pcprof_nodes[pcprofContext(func)].samples;
+  ++pcprof_total;
+}
+
+const char* pcprofName(int func) {
+  return func == PCPROF_UNKNOWN ? "??" : syms[func].name;
+}
+
+// Write the node's stack as "outer;...;func".
+void pcprofPath(FILE* f, int n) {
+  int parent = pcprof_nodes[n].parent;
+  if (parent > 0) {
+    pcprofPath(f, parent);
+    fputc(';', f);
+  }
+  fputs(pcprofName(pcprof_nodes[n].func), f);
+}
+
+int pcprofCmp(const void* a, const void* b) {
+  uint64_t x = pcprof_samples[*(const int*)a], y = pcprof_samples[*(const int*)b];
+  return (x < y) - (x > y);  // Descending.
+}
+
+void pcprofDump() {
+  static int order[SYM_MAX + 1];
+  int n = 0;
+  for (int i = 0; i < sym_num; ++i) {
+    if (pcprof_samples[i]) order[n++] = i;
+  }
+  if (pcprof_samples[SYM_MAX]) order[n++] = SYM_MAX;
+  qsort(order, n, sizeof(int), pcprofCmp);
+
+  printf("\nFlat profile (%llu samples)\n", (unsigned long long)pcprof_total);
+  printf("%10s %7s  %s\n", "samples", "%", "function");
+  for (int i = 0; i < n; ++i) {
+    uint64_t c = pcprof_samples[order[i]];
+    printf("%10llu %6.2f%%  %s\n", (unsigned long long)c,
+           100.0 * c / pcprof_total, pcprofName(order[i]));
+  }
+  if (pcprof_lost) printf("%d calls not tracked (stack or tree full)\n", pcprof_lost);
+
+  FILE* f = fopen(PROF_FOLDED, "w");
+  if (!f) return;
+  for (int i = 1; i < pcprof_node_num; ++i) {
+    if (!pcprof_nodes[i].samples) continue;
+    pcprofPath(f, i);
+    fprintf(f, " %llu\n", (unsigned long long)pcprof_nodes[i].samples);
+  }
+  fclose(f);
+  printf("Collapsed stacks written to %s\n", PROF_FOLDED);
+}
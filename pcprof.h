@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+// Statistical PC-sampling profiler, enabled with -DPC_PROF.
+// Samples the guest pc every PROF_INTERVAL retired instructions, or every
+// PROF_TIMER_US microseconds of host CPU time if that is defined (host only).
+// Samples are resolved to functions through the ELF symbol table. Calls and
+// returns keep a shadow stack of calling contexts (nothing runs per
+// instruction), so each sample is also charged to its full stack.
+
+#ifndef PROF_INTERVAL
+#define PROF_INTERVAL 1009  // Prime, to avoid locking onto loop periods.
+#endif
+#ifndef PROF_NODES
+#define PROF_NODES 16384  // Distinct calling contexts.
+#endif
+#ifndef PROF_DEPTH
+#define PROF_DEPTH 1024   // Shadow stack depth.
+#endif
+#ifndef PROF_FOLDED
+#define PROF_FOLDED "pcprof.folded"  // Collapsed stacks for flamegraph.pl.
+#endif
+
+extern volatile int pcprof_tick;
+extern uint32_t pcprof_countdown;
+
+#ifdef PROF_TIMER_US
+#define PCPROF_DUE() (pcprof_tick)
+#else
+#define PCPROF_DUE() (--pcprof_countdown == 0)
+#endif
+
+// Clear the profile and (re)arm the sampling timer.
+void pcprofReset();
+
+void pcprofSample(uint32_t pc);
+
+// Guest at from called target, returning to ret.
+void pcprofCall(uint32_t from, uint32_t target, uint32_t ret);
+
+// Guest returned to target.
+void pcprofReturn(uint32_t target);
+
+// Print the flat profile and write the collapsed-stack file.
+void pcprofDump();
@@ -0,0 +1,204 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pipe.h"
+
+#define FIELD(x, hi, lo) (((x) >> (lo)) & ((1u << ((hi) - (lo) + 1)) - 1))
+#define BHT_SIZE (1u << PIPE_BHT_BITS)
+
+enum PipeLoss {
+  LOSS_LOAD_USE, LOSS_MULTI, LOSS_MISPREDICT, LOSS_REDIRECT, LOSS_CACHE,
+  LOSS_NUM
+};
+const char* pipe_loss_names[LOSS_NUM] = {
+  "load-use", "multi-cycle", "mispredict", "redirect", "cache miss",
+};
+
+uint64_t pipe_cycles = 0;
+uint64_t pipe_loss[LOSS_NUM];
+uint64_t pipe_branches = 0, pipe_mispredicts = 0;
+uint64_t pipe_taken = 0, pipe_btb_hits = 0;  // Taken transfers, BTB hits.
+
+uint8_t pipe_bht[BHT_SIZE];  // 2-bit counters; 2 and 3 predict taken.
+uint32_t pipe_ghr = 0;       // Global branch history, newest in bit 0.
+struct {
+  uint32_t tag;  // pc | 1, 0 if empty.
+  uint32_t target;
+} pipe_btb[PIPE_BTB_SIZE ? PIPE_BTB_SIZE : 1];
+
+uint32_t pipe_load_rd = 0;  // Destination of the previous instruction if a load.
+uint32_t pipe_miss = 0;     // Cache-miss cycles of the current instruction.
+
+void pipeReset() {
+  pipe_cycles = pipe_branches = pipe_mispredicts = 0;
+  pipe_taken = pipe_btb_hits = 0;
+  memset(pipe_loss, 0, sizeof(pipe_loss));
+  memset(pipe_bht, 1, sizeof(pipe_bht));  // Weakly not taken.
+  memset(pipe_btb, 0, sizeof(pipe_btb));
+  pipe_ghr = pipe_load_rd = pipe_miss = 0;
+}
+
+void pipeCacheMiss() { pipe_miss += PIPE_MISS_CYCLES; }
+
+// Whether the BTB entry for pc holds target.
+bool pipeBtbHit(uint32_t pc, uint32_t target) {
+  if (!PIPE_BTB_SIZE) return false;
+  uint32_t i = (pc >> 1) % (PIPE_BTB_SIZE ? PIPE_BTB_SIZE : 1);
+  return pipe_btb[i].tag == (pc | 1) && pipe_btb[i].target == target;
+}
+
+void pipeBtbUpdate(uint32_t pc, uint32_t target) {
+  if (!PIPE_BTB_SIZE) return;
+  uint32_t i = (pc >> 1) % (PIPE_BTB_SIZE ? PIPE_BTB_SIZE : 1);
+  pipe_btb[i].tag = pc | 1;
+  pipe_btb[i].target = target;
+}
+
+// Predict and train the direction of the conditional branch at pc.
+bool pipePredict(uint32_t inst, uint32_t pc, uint32_t target, bool taken) {
+  uint32_t i = PIPE_PRED == PRED_GSHARE ? ((pc >> 1) ^ pipe_ghr) % BHT_SIZE
+                                        : (pc >> 1) % BHT_SIZE;
+  bool pred;
+  switch (PIPE_PRED) {
+    case PRED_STATIC:
+      pred = (int32_t)inst < 0;  // Negative offset: backward.
+      break;
+    case PRED_BTB:
+      pred = pipeBtbHit(pc, target);
+      break;
+    default:
+      pred = pipe_bht[i] >= 2;
+      break;
+  }
+  if (taken && pipe_bht[i] < 3) ++pipe_bht[i];
+  if (!taken && pipe_bht[i] > 0) --pipe_bht[i];
+  pipe_ghr = ((pipe_ghr << 1) | taken) % BHT_SIZE;
+  return pred;
+}
+
+// Extra EX cycles of multi-cycle operations.
+uint32_t pipeMulti(uint32_t inst) {
+  uint32_t opcode = FIELD(inst, 6, 0), funct7 = FIELD(inst, 31, 25);
+  switch (opcode) {
+    case 0b0110011:  // OP: M extension
+      if (funct7 != 1) return 0;
+      return (FIELD(inst, 14, 12) < 4 ? PIPE_MUL_CYCLES : PIPE_DIV_CYCLES) - 1;
+    case 0b1000011:  // FMADD/FMSUB/FNMSUB/FNMADD
+    case 0b1000111:
+    case 0b1001011:
+    case 0b1001111:
+      return PIPE_FP_CYCLES - 1;
+    case 0b1010011:  // OP-FP
+      switch (funct7 >> 2) {
+        case 0x03:  // fdiv
+        case 0x0b:  // fsqrt
+          return PIPE_FDIV_CYCLES - 1;
+        case 0x00:  // fadd
+        case 0x01:  // fsub
+        case 0x02:  // fmul
+        case 0x08:  // fcvt.s.d / fcvt.d.s
+        case 0x18:  // fcvt.w[u].*
+        case 0x1a:  // fcvt.*.w[u]
+          return PIPE_FP_CYCLES - 1;
+      }
+      return 0;
+  }
+  return 0;
+}
+
+uint32_t pipeRetire(uint32_t inst, uint32_t pc, uint32_t fall, uint32_t next) {
+  uint32_t opcode = FIELD(inst, 6, 0), funct3 = FIELD(inst, 14, 12);
+  uint32_t rd = FIELD(inst, 11, 7), rs1 = FIELD(inst, 19, 15),
+           rs2 = FIELD(inst, 24, 20);
+  uint32_t loss[LOSS_NUM] = {0};
+
+  // Integer source registers read in ID/EX.
+  bool use1 = false, use2 = false;
+  switch (opcode) {
+    case 0b0110011:  // OP
+    case 0b1100011:  // BRANCH
+      use1 = use2 = true;
+      break;
+    case 0b0100011:  // STORE: the data (rs2) is forwarded to MEM.
+    case 0b0000011:  // LOAD
+    case 0b0000111:  // LOAD-FP
+    case 0b0100111:  // STORE-FP
+    case 0b0010011:  // OP-IMM
+    case 0b1100111:  // JALR
+      use1 = true;
+      break;
+    case 0b1110011:  // SYSTEM: csrrw/csrrs/csrrc
+      use1 = funct3 && funct3 < 4;
+      break;
+  }
+  if (pipe_load_rd && ((use1 && rs1 == pipe_load_rd) ||
+                       (use2 && rs2 == pipe_load_rd)))
+    loss[LOSS_LOAD_USE] = PIPE_LOAD_USE;
+  pipe_load_rd = opcode == 0b0000011 ? rd : 0;
+
+  loss[LOSS_MULTI] = pipeMulti(inst);
+
+  bool taken = next != fall;
+  if (opcode == 0b1100011) {  // Conditional branch.
+    ++pipe_branches;
+    uint32_t target = taken ? next : fall;
+    if (!taken) {  // Recompute the target for the predictor.
+      int32_t imm = (FIELD(inst, 31, 31) << 12) | (FIELD(inst, 7, 7) << 11) |
+                    (FIELD(inst, 30, 25) << 5) | (FIELD(inst, 11, 8) << 1);
+      target = pc + ((imm << 19) >> 19);
+    }
+    if (pipePredict(inst, pc, target, taken) != taken) {
+      ++pipe_mispredicts;
+      loss[LOSS_MISPREDICT] = PIPE_MISPREDICT;
+    } else if (taken && !pipeBtbHit(pc, next)) {
+      loss[LOSS_REDIRECT] = PIPE_REDIRECT;
+    }
+    // A BTB-only predictor holds just the branches last seen taken.
+    if (PIPE_PRED == PRED_BTB && !taken && pipeBtbHit(pc, target))
+      pipe_btb[(pc >> 1) % (PIPE_BTB_SIZE ? PIPE_BTB_SIZE : 1)].tag = 0;
+  } else if (opcode == 0b1101111 || opcode == 0b1100111) {  // JAL, JALR
+    taken = true;
+    if (!pipeBtbHit(pc, next)) {
+      if (opcode == 0b1101111)
+        loss[LOSS_REDIRECT] = PIPE_REDIRECT;
+      else  // JALR targets are known in EX.
+        loss[LOSS_MISPREDICT] = PIPE_MISPREDICT;
+    }
+  }
+  if (taken) {
+    ++pipe_taken;
+    pipe_btb_hits += pipeBtbHit(pc, next);
+    pipeBtbUpdate(pc, next);
+  }
+
+  loss[LOSS_CACHE] = pipe_miss;
+  pipe_miss = 0;
+  uint32_t cycles = 1;
+  for (int i = 0; i < LOSS_NUM; ++i) {
+    pipe_loss[i] += loss[i];
+    cycles += loss[i];
+  }
+  pipe_cycles += cycles;
+  return cycles;
+}
+
+void pipeDump(uint64_t instret) {
+  static const char* pred[] = {"static BTFN", "bimodal", "gshare", "BTB"};
+  printf("\nPipeline model (%s, %u counters, %u-entry BTB)\n",
+         pred[PIPE_PRED], BHT_SIZE, PIPE_BTB_SIZE);
+  printf("cycles %llu, instructions %llu, CPI %.3f\n",
+         (unsigned long long)pipe_cycles, (unsigned long long)instret,
+         instret ? (double)pipe_cycles / instret : 0.0);
+  printf("%-12s %14s %8s %8s\n", "lost to", "cycles", "%", "CPI");
+  for (int i = 0; i < LOSS_NUM; ++i)
+    printf("%-12s %14llu %7.2f%% %8.3f\n", pipe_loss_names[i],
+           (unsigned long long)pipe_loss[i],
+           pipe_cycles ? 100.0 * pipe_loss[i] / pipe_cycles : 0.0,
+           instret ? (double)pipe_loss[i] / instret : 0.0);
+  printf("branches %llu, mispredicted %llu (%.2f%%); taken transfers %llu, "
+         "BTB hits %llu\n",
+         (unsigned long long)pipe_branches, (unsigned long long)pipe_mispredicts,
+         pipe_branches ? 100.0 * pipe_mispredicts / pipe_branches : 0.0,
+         (unsigned long long)pipe_taken, (unsigned long long)pipe_btb_hits);
+}
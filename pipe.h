@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+// Cycle-approximate timing for an in-order 5-stage pipeline (IF ID EX MEM
+// WB), enabled with -DPIPE_MODEL. Every retired instruction costs one cycle
+// plus its stalls: load-use hazards, multi-cycle EX operations, branch
+// mispredictions and taken-branch/jump redirects, and (with -DCACHE_SIM)
+// cache misses. The estimate drives the cycle CSR; CPI and the breakdown of
+// lost cycles are printed at exit.
+
+enum PipePredictor {
+  PRED_STATIC,   // Backward taken, forward not taken.
+  PRED_BIMODAL,  // 2-bit counters indexed by pc.
+  PRED_GSHARE,   // 2-bit counters indexed by pc xor global history.
+  PRED_BTB,      // Taken iff the branch hits in the BTB.
+};
+#ifndef PIPE_PRED
+#define PIPE_PRED PRED_GSHARE
+#endif
+#ifndef PIPE_BHT_BITS
+#define PIPE_BHT_BITS 10  // log2 of the counter table; also gshare history.
+#endif
+#ifndef PIPE_BTB_SIZE
+#define PIPE_BTB_SIZE 64  // Direct-mapped BTB entries; 0 disables the BTB.
+#endif
+
+// Penalties in cycles. Branches resolve in EX; a predicted-taken branch or
+// jump without a BTB hit loses the fetch slot while ID computes its target.
+#ifndef PIPE_MISPREDICT
+#define PIPE_MISPREDICT 2
+#endif
+#ifndef PIPE_REDIRECT
+#define PIPE_REDIRECT 1
+#endif
+#ifndef PIPE_LOAD_USE
+#define PIPE_LOAD_USE 1
+#endif
+#ifndef PIPE_MUL_CYCLES
+#define PIPE_MUL_CYCLES 3  // EX occupancy.
+#endif
+#ifndef PIPE_DIV_CYCLES
+#define PIPE_DIV_CYCLES 34
+#endif
+#ifndef PIPE_FP_CYCLES
+#define PIPE_FP_CYCLES 4  // FP add/mul/fma/convert.
+#endif
+#ifndef PIPE_FDIV_CYCLES
+#define PIPE_FDIV_CYCLES 20  // FP divide and square root.
+#endif
+#ifndef PIPE_MISS_CYCLES
+#define PIPE_MISS_CYCLES 10  // Per cache miss (-DCACHE_SIM).
+#endif
+
+void pipeReset();
+
+// Instruction inst (32-bit form) at pc retired; fall is the next sequential
+// pc and next the pc it continued at. Returns the cycles it cost.
+uint32_t pipeRetire(uint32_t inst, uint32_t pc, uint32_t fall, uint32_t next);
+
+// The current instruction missed in a cache.
+void pipeCacheMiss();
+
+// Print CPI, lost cycles by cause and predictor statistics.
+void pipeDump(uint64_t instret);
@@ -0,0 +1,33 @@
+#pragma once
+
+// USDT static tracepoints (provider "rvemu") for bpftrace, perf and SystemTap.
+// With <sys/sdt.h> (systemtap-sdt-dev) each probe is a single nop plus an ELF
+// note, so a normal run pays nothing. Without it, or with -DNO_PROBES, the
+// probes compile away. List them with: bpftrace -l 'usdt:./main:*'
+//
+//   retire(pc, inst, instret)   instruction retired
+//   ecall(num, arg)             environment call, before handleEcall: a7, a0
+//                               for newlib calls, else a0, a1
+//   ebreak(pc)                  breakpoint, guest paused
+//   load(entry, len, status)    ELF load finished (status 0 = ok)
+//   reset()                     emulator reset
+//   mem_fault(addr, pc, store)  guest access outside memory
+
+#if !defined(__NIOS2__) && !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PROBES_ENABLED
+#endif
+#endif
+
+#ifdef PROBES_ENABLED
+#define PROBE0(name) DTRACE_PROBE(rvemu, name)
+#define PROBE1(name, a) DTRACE_PROBE1(rvemu, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(rvemu, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(rvemu, name, a, b, c)
+#else
+#define PROBE0(name)
+#define PROBE1(name, a)
+#define PROBE2(name, a, b)
+#define PROBE3(name, a, b, c)
+#endif
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "replay.h"
+#include "sys.h"
+
+// Argument registers.
+#define A0 10
+#define A1 11
+#define A7 17
+
+#define REPLAY_MAGIC "rv32 replay 1\n"
+
+FILE *replay_file = NULL;
+bool replay_live = false;      // Replay: the log ended or the guest diverged.
+bool replay_diverged = false;
+uint64_t replay_instret = 0;   // Instret of the previous event.
+uint64_t replay_time = 0;      // Previous time value.
+uint64_t replay_events = 0;
+
+// Next logged event, read ahead (type 0: none yet).
+struct {
+  int type;
+  uint64_t instret, value;  // value: syscall result for INPUT_SYSCALL.
+  uint32_t num, addr, len;  // Syscall number and filled memory.
+} replay_next;
+
+const char *replayName(int type) {
+  static const char *names[] = {"?", "keys", "switches", "time", "syscall"};
+  return type >= INPUT_KEYS && type <= INPUT_SYSCALL ? names[type] : names[0];
+}
+
+uint64_t replayZig(int64_t v) { return ((uint64_t)v << 1) ^ (v >> 63); }
+int64_t replayUnzig(uint64_t v) { return (v >> 1) ^ -(v & 1); }
+
+void replayPut(uint64_t v) {
+  do {
+    uint8_t b = v & 0x7f;
+    v >>= 7;
+    fputc(b | (v ? 0x80 : 0), replay_file);
+  } while (v);
+}
+
+bool replayGet(uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(replay_file);
+    if (c == EOF) return false;
+    *v |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80)) return true;
+  }
+  return false;
+}
+
+void replayReset() {
+  replay_instret = replay_time = 0;
+  if (replay_file || replay_live) return;
+#ifdef RECORD
+  replay_file = fopen(REPLAY_LOG, "wb");
+  if (!replay_file) {
+    printf("record: cannot write %s\n", REPLAY_LOG);
+    return;
+  }
+  fputs(REPLAY_MAGIC, replay_file);
+#else
+  char magic[sizeof(REPLAY_MAGIC)] = {0};
+  replay_file = fopen(REPLAY_LOG, "rb");
+  if (!replay_file || !fgets(magic, sizeof(magic), replay_file) ||
+      strcmp(magic, REPLAY_MAGIC)) {
+    printf("replay: cannot read %s, running live\n", REPLAY_LOG);
+    replay_live = true;
+  }
+#endif
+}
+
+#ifdef RECORD
+void replayRecord(int type, uint64_t instret) {
+  fputc(type, replay_file);
+  replayPut(instret - replay_instret);
+  replay_instret = instret;
+  ++replay_events;
+}
+
+uint64_t replayInput(int type, uint64_t value, uint64_t instret) {
+  if (!replay_file || (type == INPUT_KEYS && !value)) return value;
+  replayRecord(type, instret);
+  if (type == INPUT_TIME) {
+    replayPut(replayZig(value - replay_time));
+    replay_time = value;
+  } else {
+    replayPut(value);
+  }
+  // Keys and switches are rare; keep them on disk if the host is killed.
+  if (type != INPUT_TIME) fflush(replay_file);
+  return value;
+}
+
+bool replaySysCall(uint32_t *x, uint8_t *mem, uint32_t mem_size,
+                   uint64_t instret) {
+  uint32_t num = x[A7], addr = x[A1];
+  bool exited = sysCall(x, mem, mem_size);
+  if (!replay_file || num == SYS_exit || num == SYS_brk) return exited;
+  int32_t ret = x[A0];
+  uint32_t len = num == SYS_read && ret > 0    ? (uint32_t)ret
+                 : num == SYS_fstat && !ret ? SYS_STAT_SIZE
+                                            : 0;
+  replayRecord(INPUT_SYSCALL, instret);
+  replayPut(num);
+  replayPut(replayZig(ret));
+  replayPut(addr);
+  replayPut(len);
+  if (len) fwrite(&mem[addr], 1, len, replay_file);
+  return exited;
+}
+
+#else  // REPLAY
+
+// Read the next event ahead. Returns false once replay has gone live.
+bool replayPeek() {
+  if (replay_live || !replay_file) return false;
+  if (replay_next.type) return true;
+  int type = fgetc(replay_file);
+  uint64_t delta, v = 0, num = 0, addr = 0, len = 0;
+  bool ok = type >= INPUT_KEYS && type <= INPUT_SYSCALL && replayGet(&delta);
+  if (ok && type == INPUT_SYSCALL)
+    ok = replayGet(&num) && replayGet(&v) && replayGet(&addr) &&
+         replayGet(&len);
+  else if (ok)
+    ok = replayGet(&v);
+  if (!ok) {  // End of the log.
+    replay_live = true;
+    return false;
+  }
+  replay_next.type = type;
+  replay_next.instret = replay_instret + delta;
+  replay_next.value = v;
+  replay_next.num = num;
+  replay_next.addr = addr;
+  replay_next.len = len;
+  return true;
+}
+
+void replayConsume() {
+  replay_instret = replay_next.instret;
+  replay_next.type = 0;
+  ++replay_events;
+}
+
+void replayDiverge(int type, uint64_t instret) {
+  printf("replay: diverged at instret %llu (%s read, log has %s at %llu), "
+         "running live\n",
+         (unsigned long long)instret, replayName(type),
+         replayName(replay_next.type),
+         (unsigned long long)replay_next.instret);
+  replay_live = replay_diverged = true;
+}
+
+uint64_t replayInput(int type, uint64_t value, uint64_t instret) {
+  if (!replayPeek()) return value;
+  if (type == INPUT_KEYS) {  // Unlogged polls returned 0.
+    if (replay_next.instret < instret) replayDiverge(type, instret);
+    if (replay_next.type != INPUT_KEYS || replay_next.instret != instret)
+      return replay_live ? value : 0;
+  } else if (replay_next.type != type || replay_next.instret != instret) {
+    replayDiverge(type, instret);
+    return value;
+  }
+  value = replay_next.value;
+  if (type == INPUT_TIME) value = replay_time += replayUnzig(value);
+  replayConsume();
+  return value;
+}
+
+bool replayKeysDue(uint64_t instret) {
+  return replayPeek() && replay_next.type == INPUT_KEYS &&
+         replay_next.instret == instret;
+}
+
+bool replaySysCall(uint32_t *x, uint8_t *mem, uint32_t mem_size,
+                   uint64_t instret) {
+  uint32_t num = x[A7];
+  if (num == SYS_exit || num == SYS_brk || !replayPeek())
+    return sysCall(x, mem, mem_size);
+  if (replay_next.type != INPUT_SYSCALL || replay_next.instret != instret ||
+      replay_next.num != num || replay_next.addr > mem_size ||
+      replay_next.len > mem_size - replay_next.addr) {
+    replayDiverge(INPUT_SYSCALL, instret);
+    return sysCall(x, mem, mem_size);
+  }
+  if ((num == SYS_write || num == SYS_writev) && (x[A0] == 1 || x[A0] == 2))
+    sysCall(x, mem, mem_size);  // Console output.
+  x[A0] = replayUnzig(replay_next.value);
+  if (fread(&mem[replay_next.addr], 1, replay_next.len, replay_file) !=
+      replay_next.len) {
+    replayDiverge(INPUT_SYSCALL, instret);
+    return false;
+  }
+  replayConsume();
+  return false;
+}
+#endif
+
+void replayDump() {
+  if (!replay_file) return;
+  fflush(replay_file);
+#ifdef RECORD
+  printf("\nrecord: %llu events, %ld bytes in %s\n",
+         (unsigned long long)replay_events, ftell(replay_file), REPLAY_LOG);
+#else
+  printf("\nreplay: %llu events from %s%s\n",
+         (unsigned long long)replay_events, REPLAY_LOG,
+         replay_diverged ? ", diverged" : "");
+#endif
+}
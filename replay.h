@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "io.h"
+
+// Deterministic record and replay of external inputs, enabled with -DRECORD
+// or -DREPLAY. Recording logs every value the guest observes from outside:
+// key presses, switch reads (ecall 200), the time CSR and the results of
+// newlib system calls, each tagged with the retired-instruction count.
+// Replaying feeds the same values back at the same instructions, so the run
+// repeats bit for bit at full speed. Console writes are repeated; other host
+// I/O is not performed. If the log ends or the guest diverges from it, replay
+// reports where and continues with live inputs.
+//
+// Log: a magic line, then one event per input: type byte, instret delta
+// since the previous event and a LEB128 payload. Key polls that return 0
+// are not logged.
+
+#if defined(RECORD) && defined(REPLAY)
+#error "RECORD and REPLAY are mutually exclusive"
+#endif
+
+#ifndef REPLAY_LOG
+#define REPLAY_LOG "replay.log"
+#endif
+
+// Open the log on the first call. Later calls (reset key) restart the
+// instret and time bases; the log continues.
+void replayReset();
+
+// Input of type read before instruction instret + 1 retires. Returns value
+// (logging it) when recording, the logged value when replaying.
+uint64_t replayInput(int type, uint64_t value, uint64_t instret);
+
+#ifdef REPLAY
+// True if the next logged event is a key press at instret, so waiting for
+// a live key press would stall the replay.
+bool replayKeysDue(uint64_t instret);
+#endif
+
+// sysCall() with its result logged or replayed. Exit and brk always run.
+bool replaySysCall(uint32_t *x, uint8_t *mem, uint32_t mem_size,
+                   uint64_t instret);
+
+// Flush the log and print its event count.
+void replayDump();
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rev.h"
+#include "sys.h"
+
+// Argument registers.
+#define A0 10
+#define A1 11
+#define A7 17
+
+#define REV_PAGE (1u << REV_PAGE_SHIFT)
+
+// Guest memory page, shared by every snapshot in which it is unchanged.
+typedef struct {
+  uint32_t refs;
+  uint8_t data[REV_PAGE];
+} RevPage;
+
+typedef struct {
+  RevCpu cpu;
+  RevPage **pages;
+} RevSnap;
+
+// Journaled input. For system calls, value is the result and [addr, +len)
+// the guest memory it filled, saved at rev_data[data].
+typedef struct {
+  uint64_t instret, value;
+  int type;
+  uint32_t num, addr, len, data;
+} RevInput;
+
+uint64_t rev_next = 0, rev_live = 0;
+uint64_t rev_interval = REV_INTERVAL;
+uint64_t rev_bytes = 0;  // Pages, snapshot tables and journal.
+uint32_t rev_pages = 0;  // Pages per snapshot.
+
+RevSnap *rev_snaps = NULL;
+uint32_t rev_snap_num = 0, rev_snap_cap = 0;
+
+RevInput *rev_inputs = NULL;
+uint32_t rev_input_num = 0, rev_input_cap = 0;
+uint32_t rev_cursor = 0;  // Next journal entry to replay.
+uint8_t *rev_data = NULL;
+uint32_t rev_data_len = 0, rev_data_cap = 0;
+
+uint64_t *rev_breaks = NULL;  // Instrets after ebreaks, ascending.
+uint32_t rev_break_num = 0, rev_break_cap = 0;
+
+// Grow *arr (of size elements) to hold need of them.
+void revGrow(void **arr, uint32_t *cap, uint32_t need, size_t size) {
+  if (need <= *cap) return;
+  uint32_t n = *cap ? *cap * 2 : 64;
+  while (n < need) n *= 2;
+  void *p = realloc(*arr, n * size);
+  if (!p) {
+    printf("reverse: out of memory\n");
+    exit(1);
+  }
+  rev_bytes += (uint64_t)(n - *cap) * size;
+  *arr = p;
+  *cap = n;
+}
+
+void revPageDrop(RevPage *p) {
+  if (p && !--p->refs) {
+    free(p);
+    rev_bytes -= sizeof(RevPage);
+  }
+}
+
+void revSnapDrop(RevSnap *s) {
+  for (uint32_t i = 0; i < rev_pages; ++i) revPageDrop(s->pages[i]);
+  free(s->pages);
+  rev_bytes -= rev_pages * sizeof(RevPage *);
+}
+
+void revReset(uint32_t mem_size) {
+  for (uint32_t i = 0; i < rev_snap_num; ++i) revSnapDrop(&rev_snaps[i]);
+  free(rev_snaps);
+  free(rev_inputs);
+  free(rev_data);
+  free(rev_breaks);
+  rev_snaps = NULL;
+  rev_inputs = NULL;
+  rev_data = NULL;
+  rev_breaks = NULL;
+  rev_snap_num = rev_snap_cap = rev_input_num = rev_input_cap = 0;
+  rev_data_len = rev_data_cap = rev_break_num = rev_break_cap = 0;
+  rev_cursor = 0;
+  rev_next = rev_live = rev_bytes = 0;
+  rev_interval = REV_INTERVAL;
+  rev_pages = mem_size >> REV_PAGE_SHIFT;
+}
+
+uint64_t revOldest() {
+  return rev_snap_num ? rev_snaps[0].cpu.instret : REV_NONE;
+}
+
+// Forget the journal and breaks from before the oldest snapshot.
+void revTrim() {
+  uint64_t oldest = revOldest();
+  uint32_t n = 0;
+  while (n < rev_input_num && rev_inputs[n].instret < oldest) ++n;
+  if (n) {
+    uint32_t skip = n < rev_input_num ? rev_inputs[n].data : rev_data_len;
+    memmove(rev_data, rev_data + skip, rev_data_len - skip);
+    rev_data_len -= skip;
+    rev_input_num -= n;
+    memmove(rev_inputs, rev_inputs + n, rev_input_num * sizeof(RevInput));
+    for (uint32_t i = 0; i < rev_input_num; ++i) rev_inputs[i].data -= skip;
+    rev_cursor = rev_cursor > n ? rev_cursor - n : 0;
+  }
+  n = 0;
+  while (n < rev_break_num && rev_breaks[n] < oldest) ++n;
+  rev_break_num -= n;
+  memmove(rev_breaks, rev_breaks + n, rev_break_num * sizeof(uint64_t));
+}
+
+// Keep within REV_MEM_MAX: drop every other snapshot (keeping the oldest
+// and newest) and double the interval, or drop the oldest if only two are
+// left. The journal and breaks buffers are not shrunk, only trimmed.
+void revThin() {
+  while (rev_bytes > REV_MEM_MAX && rev_snap_num > 1) {
+    uint32_t n = 0;
+    if (rev_snap_num == 2) {
+      revSnapDrop(&rev_snaps[0]);
+      rev_snaps[n++] = rev_snaps[1];
+      revTrim();
+    } else {
+      for (uint32_t i = 0; i < rev_snap_num; ++i) {
+        if (i % 2 && i != rev_snap_num - 1) revSnapDrop(&rev_snaps[i]);
+        else rev_snaps[n++] = rev_snaps[i];
+      }
+      rev_interval *= 2;
+    }
+    rev_snap_num = n;
+  }
+}
+
+void revSnapshot(const RevCpu *cpu, const uint8_t *mem) {
+  revGrow((void **)&rev_snaps, &rev_snap_cap, rev_snap_num + 1,
+          sizeof(RevSnap));
+  RevSnap *prev = rev_snap_num ? &rev_snaps[rev_snap_num - 1] : NULL;
+  RevSnap *s = &rev_snaps[rev_snap_num];
+  s->cpu = *cpu;
+  s->pages = malloc(rev_pages * sizeof(RevPage *));
+  if (!s->pages) return;
+  rev_bytes += rev_pages * sizeof(RevPage *);
+  for (uint32_t i = 0; i < rev_pages; ++i) {
+    const uint8_t *src = &mem[i << REV_PAGE_SHIFT];
+    RevPage *p = prev ? prev->pages[i] : NULL;
+    if (!p || memcmp(p->data, src, REV_PAGE)) {  // Dirty since prev.
+      p = malloc(sizeof(RevPage));
+      if (!p) {
+        while (i--) revPageDrop(s->pages[i]);
+        free(s->pages);
+        rev_bytes -= rev_pages * sizeof(RevPage *);
+        return;
+      }
+      p->refs = 0;
+      memcpy(p->data, src, REV_PAGE);
+      rev_bytes += sizeof(RevPage);
+    }
+    ++p->refs;
+    s->pages[i] = p;
+  }
+  ++rev_snap_num;
+  rev_next = cpu->instret + rev_interval;
+  revThin();
+}
+
+bool revRestore(uint64_t target, uint64_t now, RevCpu *cpu, uint8_t *mem) {
+  uint32_t i = rev_snap_num;
+  while (i && rev_snaps[i - 1].cpu.instret > target) --i;
+  if (!i) return false;
+  const RevSnap *s = &rev_snaps[i - 1];
+  for (uint32_t k = 0; k < rev_pages; ++k)
+    memcpy(&mem[k << REV_PAGE_SHIFT], s->pages[k]->data, REV_PAGE);
+  *cpu = s->cpu;
+  if (now > rev_live) rev_live = now;
+  // Replay the journal from the snapshot on.
+  uint32_t lo = 0, hi = rev_input_num;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (rev_inputs[mid].instret < s->cpu.instret) lo = mid + 1;
+    else hi = mid;
+  }
+  rev_cursor = lo;
+  return true;
+}
+
+void revBreak(uint64_t instret) {
+  if (rev_break_num && rev_breaks[rev_break_num - 1] >= instret + 1) return;
+  revGrow((void **)&rev_breaks, &rev_break_cap, rev_break_num + 1,
+          sizeof(uint64_t));
+  rev_breaks[rev_break_num++] = instret + 1;
+}
+
+uint64_t revLastBreak(uint64_t now) {
+  uint32_t i = rev_break_num;
+  while (i && rev_breaks[i - 1] >= now) --i;
+  return i ? rev_breaks[i - 1] : revOldest();
+}
+
+RevInput *revJournal(int type, uint64_t value, uint64_t instret) {
+  revGrow((void **)&rev_inputs, &rev_input_cap, rev_input_num + 1,
+          sizeof(RevInput));
+  RevInput *in = &rev_inputs[rev_input_num++];
+  memset(in, 0, sizeof(*in));
+  in->type = type;
+  in->value = value;
+  in->instret = instret;
+  in->data = rev_data_len;
+  rev_cursor = rev_input_num;
+  return in;
+}
+
+// Next journal entry if it is the input of type at instret.
+RevInput *revReplay(int type, uint64_t instret) {
+  if (rev_cursor < rev_input_num && rev_inputs[rev_cursor].type == type &&
+      rev_inputs[rev_cursor].instret == instret)
+    return &rev_inputs[rev_cursor++];
+  printf("reverse: re-execution diverged at instret %llu\n",
+         (unsigned long long)instret);
+  return NULL;
+}
+
+uint64_t revInput(int type, uint64_t value, uint64_t instret) {
+  if (type == INPUT_KEYS) return value;  // Debugger controls, not guest input.
+  if (!REV_REPLAYING(instret)) {
+    revJournal(type, value, instret);
+    return value;
+  }
+  RevInput *in = revReplay(type, instret);
+  return in ? in->value : value;
+}
+
+bool revSysRecord(const uint32_t *x, const uint8_t *mem, uint64_t instret,
+                  bool exited) {
+  uint32_t num = x[A7];
+  if (num == SYS_exit) return exited;
+  int32_t ret = x[A0];
+  uint32_t len = num == SYS_read && ret > 0    ? (uint32_t)ret
+                 : num == SYS_fstat && !ret ? SYS_STAT_SIZE
+                                            : 0;
+  revGrow((void **)&rev_data, &rev_data_cap, rev_data_len + len, 1);
+  RevInput *in = revJournal(INPUT_SYSCALL, ret, instret);
+  in->num = num;
+  in->addr = x[A1];
+  in->len = len;
+  if (len) memcpy(rev_data + rev_data_len, &mem[in->addr], len);
+  rev_data_len += len;
+  return exited;
+}
+
+bool revSysReplay(uint32_t *x, uint8_t *mem, uint32_t mem_size,
+                  uint64_t instret) {
+  if (x[A7] == SYS_exit) return sysCall(x, mem, mem_size);
+  RevInput *in = revReplay(INPUT_SYSCALL, instret);
+  if (!in) return sysCall(x, mem, mem_size);
+  x[A0] = in->value;
+  if (in->len) memcpy(&mem[in->addr], rev_data + in->data, in->len);
+  return false;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "io.h"
+#include "trap.h"
+#include "vec.h"
+
+// Reverse execution, enabled with -DREVERSE. Every REV_INTERVAL retired
+// instructions the guest state is snapshotted: registers, pc, counters and
+// the memory pages that changed since the previous snapshot (unchanged pages
+// are shared). Going back restores the nearest snapshot at or before the
+// target and re-executes forward to it. Guest inputs (switches, time CSR,
+// system calls) are journaled while running live and served from the journal
+// during re-execution, so the re-run is identical and does no host I/O.
+// When snapshots and journal exceed REV_MEM_MAX bytes, every other snapshot
+// is dropped and the interval doubles.
+//
+// KEY2 while paused steps back one instruction; while running (or after the
+// guest exited) it reverse-continues to just after the last ebreak, or to
+// the oldest snapshot, and pauses there.
+
+#ifndef REV_INTERVAL
+#define REV_INTERVAL 100000  // Initial instructions between snapshots.
+#endif
+#ifndef REV_MEM_MAX
+#define REV_MEM_MAX (64u << 20)  // Bytes of snapshots and journal.
+#endif
+#define REV_PAGE_SHIFT 12
+
+#define REV_NONE UINT64_MAX
+
+// Architectural state saved with each snapshot.
+typedef struct {
+  uint32_t reg[32], pc;
+  uint64_t instret, cycle, freg[32];
+  uint32_t fcsr, vl, vtype;
+  uint8_t vreg[32 * VLENB];
+  TrapState trap;
+  uint64_t trap_poll_at;  // Interrupt checks fall on the same instructions.
+} RevCpu;
+
+extern uint64_t rev_next;  // Instret of the next snapshot.
+extern uint64_t rev_live;  // Furthest instret reached; re-executing below it.
+
+#define REV_DUE(instret) ((instret) >= rev_next)
+#define REV_REPLAYING(instret) ((instret) < rev_live)
+
+// Drop all snapshots and the journal; mem_size is the guest memory size.
+void revReset(uint32_t mem_size);
+
+// Snapshot cpu and mem (when REV_DUE).
+void revSnapshot(const RevCpu *cpu, const uint8_t *mem);
+
+// Restore the latest snapshot at or before target into cpu and mem, from a
+// run that has reached instret now. Returns false if target is older than
+// every snapshot.
+bool revRestore(uint64_t target, uint64_t now, RevCpu *cpu, uint8_t *mem);
+
+// Instret of the oldest snapshot.
+uint64_t revOldest();
+
+// An ebreak retired as instruction instret + 1.
+void revBreak(uint64_t instret);
+
+// Instret just after the last ebreak that retired before now, or the oldest
+// snapshot if there is none.
+uint64_t revLastBreak(uint64_t now);
+
+// Input of type read at instret: journaled when live, replayed from the
+// journal when re-executing. Keys are passed through.
+uint64_t revInput(int type, uint64_t value, uint64_t instret);
+
+// Journal the system call that just ran live (exited: its sysCall result).
+bool revSysRecord(const uint32_t *x, const uint8_t *mem, uint64_t instret,
+                  bool exited);
+
+// Re-execute a journaled system call: restore a0 and the memory it filled.
+// Exit runs live. Returns true if the guest exited.
+bool revSysReplay(uint32_t *x, uint8_t *mem, uint32_t mem_size,
+                  uint64_t instret);
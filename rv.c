@@ -30,21 +30,23 @@ int main() {
 void putInt(int n) {
   asm volatile(
       "li a0, 100\n"
+      "li a7, 0\n"
       "mv a1, %0\n"
       "ecall\n"
       :
       : "r"(n)
-      : "a0", "a1");
+      : "a0", "a1", "a7");
 }
 
 void putStr(char* str) {
   asm volatile(
       "li a0, 101\n"
+      "li a7, 0\n"
       "mv a1, %0\n"
       "ecall\n"
       :
       : "r"(str)
-      : "a0", "a1");
+      : "a0", "a1", "a7");
 }
 
 int getInt() {
@@ -52,10 +54,11 @@ int getInt() {
   asm volatile(
       "ebreak\n"
       "li a0, 200\n"
+      "li a7, 0\n"
       "ecall\n"
       "mv %0, a0\n"
       : "=r"(result)
       :
-      : "a0");
+      : "a0", "a7");
   return result;
 }
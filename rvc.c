@@ -0,0 +1,161 @@
+#include "rvc.h"
+
+uint32_t rvc_cache[1 << 16];
+
+// Bits hi..lo of x.
+#define BITS(x, hi, lo) (((x) >> (lo)) & ((1u << ((hi) - (lo) + 1)) - 1))
+// Sign-extend the low n bits of x.
+#define SEXT(x, n) ((int32_t)((uint32_t)(x) << (32 - (n))) >> (32 - (n)))
+// Compressed register fields x8-x15.
+#define RD_P(c) (BITS(c, 4, 2) + 8)
+#define RS1_P(c) (BITS(c, 9, 7) + 8)
+
+// 32-bit opcodes used by expansions.
+enum {
+  OP_LOAD = 0x03, OP_LOAD_FP = 0x07, OP_IMM = 0x13, OP_STORE = 0x23,
+  OP_STORE_FP = 0x27, OP_OP = 0x33, OP_LUI = 0x37, OP_BRANCH = 0x63,
+  OP_JALR = 0x67, OP_JAL = 0x6F, OP_SYSTEM = 0x73
+};
+
+uint32_t rvcI(uint32_t op, uint32_t f3, uint32_t rd, uint32_t rs1, int32_t imm) {
+  return (imm & 0xFFF) << 20 | rs1 << 15 | f3 << 12 | rd << 7 | op;
+}
+
+uint32_t rvcS(uint32_t op, uint32_t f3, uint32_t rs1, uint32_t rs2, int32_t imm) {
+  return ((imm >> 5) & 0x7F) << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 |
+         (imm & 0x1F) << 7 | op;
+}
+
+uint32_t rvcB(uint32_t f3, uint32_t rs1, uint32_t rs2, int32_t imm) {
+  return ((imm >> 12) & 1) << 31 | ((imm >> 5) & 0x3F) << 25 | rs2 << 20 |
+         rs1 << 15 | f3 << 12 | ((imm >> 1) & 0xF) << 8 |
+         ((imm >> 11) & 1) << 7 | OP_BRANCH;
+}
+
+uint32_t rvcJ(uint32_t rd, int32_t imm) {
+  return ((imm >> 20) & 1) << 31 | ((imm >> 1) & 0x3FF) << 21 |
+         ((imm >> 11) & 1) << 20 | ((imm >> 12) & 0xFF) << 12 | rd << 7 | OP_JAL;
+}
+
+uint32_t rvcR(uint32_t f7, uint32_t f3, uint32_t rd, uint32_t rs1, uint32_t rs2) {
+  return f7 << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | rd << 7 | OP_OP;
+}
+
+uint32_t rvcQuadrant0(uint16_t c) {
+  // Offsets of C.LW/C.SW/C.FLW/C.FSW and of the doubleword C.FLD/C.FSD.
+  int32_t w_off = BITS(c, 12, 10) << 3 | BITS(c, 6, 6) << 2 | BITS(c, 5, 5) << 6;
+  int32_t d_off = BITS(c, 12, 10) << 3 | BITS(c, 6, 5) << 6;
+  switch (BITS(c, 15, 13)) {
+    case 0b000: {  // C.ADDI4SPN
+      int32_t imm = BITS(c, 12, 11) << 4 | BITS(c, 10, 7) << 6 |
+                    BITS(c, 6, 6) << 2 | BITS(c, 5, 5) << 3;
+      if (imm == 0) return RVC_ILLEGAL;  // Includes the all-zero halfword.
+      return rvcI(OP_IMM, 0b000, RD_P(c), 2, imm);
+    }
+    case 0b001: return rvcI(OP_LOAD_FP, 0b011, RD_P(c), RS1_P(c), d_off);   // C.FLD
+    case 0b010: return rvcI(OP_LOAD, 0b010, RD_P(c), RS1_P(c), w_off);      // C.LW
+    case 0b011: return rvcI(OP_LOAD_FP, 0b010, RD_P(c), RS1_P(c), w_off);   // C.FLW
+    case 0b101: return rvcS(OP_STORE_FP, 0b011, RS1_P(c), RD_P(c), d_off);  // C.FSD
+    case 0b110: return rvcS(OP_STORE, 0b010, RS1_P(c), RD_P(c), w_off);     // C.SW
+    case 0b111: return rvcS(OP_STORE_FP, 0b010, RS1_P(c), RD_P(c), w_off);  // C.FSW
+    default: return RVC_ILLEGAL;
+  }
+}
+
+uint32_t rvcQuadrant1(uint16_t c) {
+  uint32_t rd = BITS(c, 11, 7);
+  int32_t imm6 = SEXT(BITS(c, 12, 12) << 5 | BITS(c, 6, 2), 6);
+  int32_t j_off = SEXT(BITS(c, 12, 12) << 11 | BITS(c, 11, 11) << 4 |
+                       BITS(c, 10, 9) << 8 | BITS(c, 8, 8) << 10 |
+                       BITS(c, 7, 7) << 6 | BITS(c, 6, 6) << 7 |
+                       BITS(c, 5, 3) << 1 | BITS(c, 2, 2) << 5, 12);
+  int32_t b_off = SEXT(BITS(c, 12, 12) << 8 | BITS(c, 11, 10) << 3 |
+                       BITS(c, 6, 5) << 6 | BITS(c, 4, 3) << 1 |
+                       BITS(c, 2, 2) << 5, 9);
+  switch (BITS(c, 15, 13)) {
+    case 0b000: return rvcI(OP_IMM, 0b000, rd, rd, imm6);  // C.ADDI, C.NOP
+    case 0b001: return rvcJ(1, j_off);                     // C.JAL
+    case 0b010: return rvcI(OP_IMM, 0b000, rd, 0, imm6);   // C.LI
+    case 0b011:
+      if (rd == 2) {  // C.ADDI16SP
+        int32_t imm = SEXT(BITS(c, 12, 12) << 9 | BITS(c, 6, 6) << 4 |
+                           BITS(c, 5, 5) << 6 | BITS(c, 4, 3) << 7 |
+                           BITS(c, 2, 2) << 5, 10);
+        if (imm == 0) return RVC_ILLEGAL;
+        return rvcI(OP_IMM, 0b000, 2, 2, imm);
+      }
+      if (imm6 == 0) return RVC_ILLEGAL;  // C.LUI
+      return (imm6 & 0xFFFFF) << 12 | rd << 7 | OP_LUI;
+    case 0b100: {
+      uint32_t rs1 = RS1_P(c), rs2 = RD_P(c);
+      switch (BITS(c, 11, 10)) {
+        case 0b00:  // C.SRLI
+          if (BITS(c, 12, 12)) return RVC_ILLEGAL;  // shamt[5] is RV64 only.
+          return rvcI(OP_IMM, 0b101, rs1, rs1, BITS(c, 6, 2));
+        case 0b01:  // C.SRAI
+          if (BITS(c, 12, 12)) return RVC_ILLEGAL;
+          return rvcI(OP_IMM, 0b101, rs1, rs1, 0x400 | BITS(c, 6, 2));
+        case 0b10:  // C.ANDI
+          return rvcI(OP_IMM, 0b111, rs1, rs1, imm6);
+        default:
+          if (BITS(c, 12, 12)) return RVC_ILLEGAL;  // C.SUBW etc. are RV64.
+          switch (BITS(c, 6, 5)) {
+            case 0b00: return rvcR(0x20, 0b000, rs1, rs1, rs2);  // C.SUB
+            case 0b01: return rvcR(0x00, 0b100, rs1, rs1, rs2);  // C.XOR
+            case 0b10: return rvcR(0x00, 0b110, rs1, rs1, rs2);  // C.OR
+            default:   return rvcR(0x00, 0b111, rs1, rs1, rs2);  // C.AND
+          }
+      }
+    }
+    case 0b101: return rvcJ(0, j_off);                    // C.J
+    case 0b110: return rvcB(0b000, RS1_P(c), 0, b_off);   // C.BEQZ
+    default:    return rvcB(0b001, RS1_P(c), 0, b_off);   // C.BNEZ
+  }
+}
+
+uint32_t rvcQuadrant2(uint16_t c) {
+  uint32_t rd = BITS(c, 11, 7), rs2 = BITS(c, 6, 2);
+  int32_t lw_off = BITS(c, 12, 12) << 5 | BITS(c, 6, 4) << 2 | BITS(c, 3, 2) << 6;
+  int32_t ld_off = BITS(c, 12, 12) << 5 | BITS(c, 6, 5) << 3 | BITS(c, 4, 2) << 6;
+  int32_t sw_off = BITS(c, 12, 9) << 2 | BITS(c, 8, 7) << 6;
+  int32_t sd_off = BITS(c, 12, 10) << 3 | BITS(c, 9, 7) << 6;
+  switch (BITS(c, 15, 13)) {
+    case 0b000:  // C.SLLI
+      if (BITS(c, 12, 12)) return RVC_ILLEGAL;
+      return rvcI(OP_IMM, 0b001, rd, rd, rs2);
+    case 0b001: return rvcI(OP_LOAD_FP, 0b011, rd, 2, ld_off);  // C.FLDSP
+    case 0b010:  // C.LWSP
+      if (rd == 0) return RVC_ILLEGAL;
+      return rvcI(OP_LOAD, 0b010, rd, 2, lw_off);
+    case 0b011: return rvcI(OP_LOAD_FP, 0b010, rd, 2, lw_off);  // C.FLWSP
+    case 0b100:
+      if (!BITS(c, 12, 12)) {
+        if (rs2 == 0) {  // C.JR
+          if (rd == 0) return RVC_ILLEGAL;
+          return rvcI(OP_JALR, 0b000, 0, rd, 0);
+        }
+        return rvcR(0x00, 0b000, rd, 0, rs2);  // C.MV
+      }
+      if (rs2 == 0) {
+        if (rd == 0) return 0x00100073;          // C.EBREAK
+        return rvcI(OP_JALR, 0b000, 1, rd, 0);   // C.JALR
+      }
+      return rvcR(0x00, 0b000, rd, rd, rs2);     // C.ADD
+    case 0b101: return rvcS(OP_STORE_FP, 0b011, 2, rs2, sd_off);  // C.FSDSP
+    case 0b110: return rvcS(OP_STORE, 0b010, 2, rs2, sw_off);     // C.SWSP
+    default:    return rvcS(OP_STORE_FP, 0b010, 2, rs2, sw_off);  // C.FSWSP
+  }
+}
+
+uint32_t rvcExpand(uint16_t c) {
+  switch (c & 0b11) {
+    case 0b00: return rvcQuadrant0(c);
+    case 0b01: return rvcQuadrant1(c);
+    case 0b10: return rvcQuadrant2(c);
+    default: return RVC_ILLEGAL;  // Not compressed.
+  }
+}
+
+uint32_t rvcFill(uint16_t c) {
+  return rvc_cache[c] = rvcExpand(c);
+}
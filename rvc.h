@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// RV32C: 16-bit instructions are expanded into their 32-bit equivalents, so
+// the execute path never sees a compressed encoding. An expansion depends
+// only on the 16 instruction bits, so it is cached in a table indexed by
+// the halfword and filled on first use.
+
+#define RVC_ILLEGAL 0xFFFFFFFF  // Expansion of reserved encodings; decodes as unknown.
+
+// True if the halfword at the start of an instruction is a compressed one.
+#define IS_RVC(half) (((half) & 0b11) != 0b11)
+
+extern uint32_t rvc_cache[1 << 16];
+
+// Expand without the cache.
+uint32_t rvcExpand(uint16_t c);
+
+// Expand and cache.
+uint32_t rvcFill(uint16_t c);
+
+#define RVC_EXPAND(c) (rvc_cache[c] ? rvc_cache[c] : rvcFill(c))
@@ -9,4 +9,5 @@ _start:
 _exit:
     mv a1, a0
     li a0, 0
+    li a7, 0
     ecall
@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "sym.h"
+
+Symbol syms[SYM_MAX];
+int sym_num = 0;
+
+// Raw symbol table of the loaded ELF, for lookups by name.
+const Elf32_Sym* sym_tab = NULL;
+int sym_tab_num = 0;
+const char* sym_str = NULL;
+uint32_t sym_str_size = 0;
+
+int symCmp(const void* a, const void* b) {
+  uint32_t x = ((const Symbol*)a)->addr, y = ((const Symbol*)b)->addr;
+  return (x > y) - (x < y);
+}
+
+int symLoad(const uint8_t* elf, uint32_t len) {
+  sym_num = sym_tab_num = 0;
+  const Elf32_Ehdr* elf_h = (const Elf32_Ehdr*)elf;
+  if (elf_h->e_shoff == 0 || elf_h->e_shentsize != sizeof(Elf32_Shdr) ||
+      elf_h->e_shoff + elf_h->e_shnum * sizeof(Elf32_Shdr) > len)
+    return 0;
+  const Elf32_Shdr* sh = (const Elf32_Shdr*)(elf + elf_h->e_shoff);
+
+  for (int i = 0; i < elf_h->e_shnum; ++i) {
+    if (sh[i].sh_type != SHT_SYMTAB || sh[i].sh_link >= elf_h->e_shnum) continue;
+    const Elf32_Shdr* str_h = &sh[sh[i].sh_link];
+    if (sh[i].sh_offset + sh[i].sh_size > len ||
+        str_h->sh_offset + str_h->sh_size > len)
+      continue;
+    const Elf32_Sym* st = (const Elf32_Sym*)(elf + sh[i].sh_offset);
+    const char* strtab = (const char*)(elf + str_h->sh_offset);
+    int n = sh[i].sh_size / sizeof(Elf32_Sym);
+    sym_tab = st;
+    sym_tab_num = n;
+    sym_str = strtab;
+    sym_str_size = str_h->sh_size;
+
+    for (int j = 1; j < n && sym_num < SYM_MAX; ++j) {
+      int type = ELF32_ST_TYPE(st[j].st_info);
+      if (type != STT_FUNC && type != STT_NOTYPE) continue;
+      // Keep code symbols only.
+      if (st[j].st_shndx == 0 || st[j].st_shndx >= elf_h->e_shnum ||
+          !(sh[st[j].st_shndx].sh_flags & SHF_EXECINSTR))
+        continue;
+      if (st[j].st_name >= str_h->sh_size || strtab[st[j].st_name] == '\0')
+        continue;
+      syms[sym_num].addr = st[j].st_value;
+      syms[sym_num].size = st[j].st_size;
+      syms[sym_num].name = strtab + st[j].st_name;
+      ++sym_num;
+    }
+  }
+  qsort(syms, sym_num, sizeof(Symbol), symCmp);
+  return sym_num;
+}
+
+bool symValue(const char* name, uint32_t* value) {
+  for (int i = 1; i < sym_tab_num; ++i) {
+    if (sym_tab[i].st_name < sym_str_size &&
+        !strcmp(sym_str + sym_tab[i].st_name, name)) {
+      *value = sym_tab[i].st_value;
+      return true;
+    }
+  }
+  return false;
+}
+
+int symLookup(uint32_t addr) {
+  // Last symbol with syms[i].addr <= addr.
+  int lo = 0, hi = sym_num;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (syms[mid].addr <= addr) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == 0) return SYM_NONE;
+  const Symbol* s = &syms[lo - 1];
+  if (s->size && addr >= s->addr + s->size) return SYM_NONE;
+  return lo - 1;
+}
+
+const char* symName(uint32_t addr) {
+  int i = symLookup(addr);
+  return i == SYM_NONE ? "??" : syms[i].name;
+}
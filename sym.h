@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Guest function symbols from the ELF .symtab, sorted by address.
+// Executables built without -s (see gen_elfh) keep their symbol table.
+
+#define SYM_MAX 4096
+#define SYM_NONE (-1)
+
+typedef struct {
+  uint32_t addr;
+  uint32_t size;     // 0 if unknown (e.g. assembly labels).
+  const char* name;  // Points into the ELF image.
+} Symbol;
+
+extern Symbol syms[SYM_MAX];
+extern int sym_num;
+
+// Build the index from an ELF image. Returns the number of symbols found.
+int symLoad(const uint8_t* elf, uint32_t len);
+
+// Look up any symbol by name in the loaded ELF, including absolute ones
+// such as __stack_top. Returns false if absent.
+bool symValue(const char* name, uint32_t* value);
+
+// Index of the symbol containing addr, or SYM_NONE.
+int symLookup(uint32_t addr);
+
+// Symbol name for addr, or "??" if unknown.
+const char* symName(uint32_t addr);
@@ -0,0 +1,301 @@
+#include "sys.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef __NIOS2__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// Argument registers.
+#define A0 10
+#define A1 11
+#define A2 12
+#define A3 13
+#define A7 17
+#define SP 2
+
+// newlib open flags (sys/_default_fcntl.h).
+#define NL_O_ACCMODE 0x0003
+#define NL_O_APPEND  0x0008
+#define NL_O_CREAT   0x0200
+#define NL_O_TRUNC   0x0400
+#define NL_O_EXCL    0x0800
+
+// newlib errno values (sys/errno.h) that differ from Linux's; 1-34 match.
+#define NL_ENOMSG       35
+#define NL_EIDRM        36
+#define NL_EDEADLK      45
+#define NL_ENOLCK       46
+#define NL_ENOSYS       88
+#define NL_ENOTEMPTY    90
+#define NL_ENAMETOOLONG 91
+#define NL_ELOOP        92
+#define NL_EOPNOTSUPP   95
+#define NL_ETIMEDOUT    116
+#define NL_EDQUOT       132
+#define NL_ESTALE       133
+#define NL_EILSEQ       138
+#define NL_EOVERFLOW    139
+#define NL_ECANCELED    140
+
+#define NL_AT_FDCWD (-100)
+#define NL_IOV_MAX  16
+
+// Guest fd -> host fd, -1 if closed.
+int sys_fd[SYS_FD_MAX] = {0, 1, 2, [3 ... SYS_FD_MAX - 1] = -1};
+uint32_t sys_brk_start = 0, sys_brk = 0;
+
+void sysReset(uint32_t brk) {
+  for (int i = 0; i < SYS_FD_MAX; ++i) {
+#ifndef __NIOS2__
+    if (i > 2 && sys_fd[i] >= 0) close(sys_fd[i]);
+#endif
+    sys_fd[i] = i <= 2 ? i : -1;
+  }
+  sys_brk = sys_brk_start = (brk + 7) & ~7u;
+}
+
+void sysSave(SysState *s) {
+  for (int i = 0; i < SYS_FD_MAX; ++i) {
+    s->fd[i] = sys_fd[i];
+    s->off[i] = 0;
+#ifndef __NIOS2__
+    if (i > 2 && sys_fd[i] >= 0) {
+      s->fd[i] = dup(sys_fd[i]);
+      s->off[i] = lseek(sys_fd[i], 0, SEEK_CUR);
+    }
+#endif
+  }
+  s->brk_start = sys_brk_start;
+  s->brk = sys_brk;
+}
+
+void sysRestore(const SysState *s) {
+  for (int i = 0; i < SYS_FD_MAX; ++i) {
+#ifndef __NIOS2__
+    if (i > 2) {
+      if (sys_fd[i] >= 0) close(sys_fd[i]);
+      sys_fd[i] = s->fd[i] >= 0 ? dup(s->fd[i]) : -1;
+      if (sys_fd[i] >= 0 && s->off[i] >= 0) lseek(sys_fd[i], s->off[i], SEEK_SET);
+      continue;
+    }
+#endif
+    sys_fd[i] = s->fd[i];
+  }
+  sys_brk_start = s->brk_start;
+  sys_brk = s->brk;
+}
+
+const char* sysName(uint32_t num) {
+  switch (num) {
+    case SYS_openat: return "openat";
+    case SYS_close:  return "close";
+    case SYS_lseek:  return "lseek";
+    case SYS_read:   return "read";
+    case SYS_write:  return "write";
+    case SYS_writev: return "writev";
+    case SYS_fstat:  return "fstat";
+    case SYS_exit:   return "exit";
+    case SYS_brk:    return "brk";
+    case SYS_open:   return "open";
+    default:         return NULL;
+  }
+}
+
+// True if [addr, addr + len) lies inside guest memory.
+bool sysRange(uint32_t addr, uint32_t len, uint32_t mem_size) {
+  return len <= mem_size && addr <= mem_size - len;
+}
+
+// Host fd for guest fd, or -1.
+int sysHostFd(uint32_t fd) {
+  return fd < SYS_FD_MAX ? sys_fd[fd] : -1;
+}
+
+#ifndef __NIOS2__
+// Guest errno for host errno e. Codes newlib lacks become EIO.
+int32_t sysErrno(int e) {
+  if (e <= ERANGE) return e;
+  switch (e) {
+    case ENOMSG:       return NL_ENOMSG;
+    case EIDRM:        return NL_EIDRM;
+    case EDEADLK:      return NL_EDEADLK;
+    case ENOLCK:       return NL_ENOLCK;
+    case ENOSYS:       return NL_ENOSYS;
+    case ENOTEMPTY:    return NL_ENOTEMPTY;
+    case ENAMETOOLONG: return NL_ENAMETOOLONG;
+    case ELOOP:        return NL_ELOOP;
+    case EOPNOTSUPP:   return NL_EOPNOTSUPP;
+    case ETIMEDOUT:    return NL_ETIMEDOUT;
+    case EDQUOT:       return NL_EDQUOT;
+    case ESTALE:       return NL_ESTALE;
+    case EILSEQ:       return NL_EILSEQ;
+    case EOVERFLOW:    return NL_EOVERFLOW;
+    case ECANCELED:    return NL_ECANCELED;
+    default:           return EIO;
+  }
+}
+
+// Keep the emulator's buffered output in order with direct writes.
+void sysFlush(int host_fd) {
+  if (host_fd == 1 || host_fd == 2) fflush(stdout);
+}
+
+int32_t sysOpen(int32_t dirfd, uint32_t path, uint32_t flags, uint32_t mode,
+                uint8_t *mem, uint32_t mem_size) {
+  if (dirfd != NL_AT_FDCWD) return -EBADF;
+  if (path >= mem_size || !memchr(&mem[path], 0, mem_size - path)) return -EFAULT;
+  int guest_fd = 3;
+  while (guest_fd < SYS_FD_MAX && sys_fd[guest_fd] >= 0) ++guest_fd;
+  if (guest_fd == SYS_FD_MAX) return -EMFILE;
+
+  int host_flags = (flags & NL_O_ACCMODE) == 1   ? O_WRONLY
+                   : (flags & NL_O_ACCMODE) == 2 ? O_RDWR
+                                                 : O_RDONLY;
+  if (flags & NL_O_APPEND) host_flags |= O_APPEND;
+  if (flags & NL_O_CREAT) host_flags |= O_CREAT;
+  if (flags & NL_O_TRUNC) host_flags |= O_TRUNC;
+  if (flags & NL_O_EXCL) host_flags |= O_EXCL;
+  int host_fd = open((char *)&mem[path], host_flags, mode & 0777);
+  if (host_fd < 0) return -errno;
+  sys_fd[guest_fd] = host_fd;
+  return guest_fd;
+}
+
+// Store v little-endian at p.
+void sysPut32(uint8_t *p, uint32_t v) { memcpy(p, &v, 4); }
+void sysPut64(uint8_t *p, uint64_t v) { memcpy(p, &v, 8); }
+
+// Fill the 128-byte rv32 kernel_stat that libgloss converts to struct stat.
+int32_t sysFstat(int host_fd, uint32_t buf, uint8_t *mem, uint32_t mem_size) {
+  if (!sysRange(buf, SYS_STAT_SIZE, mem_size)) return -EFAULT;
+  struct stat st;
+  if (fstat(host_fd, &st)) return -errno;
+  uint8_t *p = &mem[buf];
+  memset(p, 0, SYS_STAT_SIZE);
+  sysPut64(p + 0, st.st_dev);
+  sysPut64(p + 8, st.st_ino);
+  sysPut32(p + 16, st.st_mode);
+  sysPut32(p + 20, st.st_nlink);
+  sysPut32(p + 24, st.st_uid);
+  sysPut32(p + 28, st.st_gid);
+  sysPut64(p + 32, st.st_rdev);
+  sysPut64(p + 48, st.st_size);
+  sysPut32(p + 56, st.st_blksize);
+  sysPut64(p + 64, st.st_blocks);
+  sysPut64(p + 72, st.st_atime);
+  sysPut64(p + 88, st.st_mtime);
+  sysPut64(p + 104, st.st_ctime);
+  return 0;
+}
+#endif
+
+int32_t sysWritev(int host_fd, uint32_t iov, uint32_t cnt, uint8_t *mem,
+                  uint32_t mem_size) {
+  if (cnt > NL_IOV_MAX) return -EINVAL;
+  if (!sysRange(iov, cnt * 8, mem_size)) return -EFAULT;
+#ifdef __NIOS2__
+  int32_t total = 0;
+#else
+  struct iovec host_iov[NL_IOV_MAX];
+#endif
+  for (uint32_t i = 0; i < cnt; ++i) {
+    uint32_t base, len;
+    memcpy(&base, &mem[iov + i * 8], 4);
+    memcpy(&len, &mem[iov + i * 8 + 4], 4);
+    if (!sysRange(base, len, mem_size)) return -EFAULT;
+#ifdef __NIOS2__
+    total += fwrite(&mem[base], 1, len, stdout);
+#else
+    host_iov[i].iov_base = &mem[base];
+    host_iov[i].iov_len = len;
+#endif
+  }
+#ifdef __NIOS2__
+  return total;
+#else
+  sysFlush(host_fd);
+  ssize_t n = writev(host_fd, host_iov, cnt);
+  return n < 0 ? -errno : n;
+#endif
+}
+
+bool sysCall(uint32_t *x, uint8_t *mem, uint32_t mem_size) {
+  uint32_t num = x[A7];
+  uint32_t a0 = x[A0], a1 = x[A1], a2 = x[A2];
+  int host_fd = sysHostFd(a0);
+  int32_t ret = -EBADF;
+#ifdef __NIOS2__
+  // No host file system on the board: stdout/stderr go to the JTAG UART.
+  if (host_fd != 1 && host_fd != 2) host_fd = -1;
+#endif
+
+  switch (num) {
+    case SYS_exit:
+      return true;
+    case SYS_brk:
+      // brk(0) queries the break; the heap may not run into the stack.
+      if (a0 >= sys_brk_start && a0 <= x[SP] && a0 <= mem_size)
+        sys_brk = a0;
+      ret = sys_brk;
+      break;
+    case SYS_write:
+      if (host_fd < 0) break;
+      if (!sysRange(a1, a2, mem_size)) { ret = -EFAULT; break; }
+#ifdef __NIOS2__
+      ret = fwrite(&mem[a1], 1, a2, stdout);
+#else
+      sysFlush(host_fd);
+      ret = write(host_fd, &mem[a1], a2);
+      if (ret < 0) ret = -errno;
+#endif
+      break;
+    case SYS_writev:
+      if (host_fd < 0) break;
+      ret = sysWritev(host_fd, a1, a2, mem, mem_size);
+      break;
+#ifdef __NIOS2__
+    default:
+      ret = -ENOSYS;
+      break;
+#else
+    case SYS_read:
+      if (host_fd < 0) break;
+      if (!sysRange(a1, a2, mem_size)) { ret = -EFAULT; break; }
+      ret = read(host_fd, &mem[a1], a2);
+      if (ret < 0) ret = -errno;
+      break;
+    case SYS_open:
+      ret = sysOpen(NL_AT_FDCWD, a0, a1, a2, mem, mem_size);
+      break;
+    case SYS_openat:
+      ret = sysOpen(a0, a1, a2, x[A3], mem, mem_size);
+      break;
+    case SYS_close:
+      if (host_fd < 0) break;
+      // Guest stdio stays open on the host.
+      ret = host_fd > 2 && close(host_fd) ? -errno : 0;
+      sys_fd[a0] = -1;
+      break;
+    case SYS_lseek: {
+      if (host_fd < 0) break;
+      off_t off = lseek(host_fd, (int32_t)a1, a2);
+      ret = off < 0 ? -errno : off > INT32_MAX ? -EOVERFLOW : (int32_t)off;
+      break;
+    }
+    case SYS_fstat:
+      if (host_fd < 0) break;
+      ret = sysFstat(host_fd, a1, mem, mem_size);
+      break;
+#endif
+  }
+#ifndef __NIOS2__
+  if (ret < 0) ret = -sysErrno(-ret);  // The board's libc is newlib already.
+#endif
+  x[A0] = ret;
+  return false;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// newlib (libgloss) system calls: number in a7, arguments in a0-a5, result
+// or -errno in a0. Buffers go to the host read/write/writev straight from
+// guest memory. Ecalls whose a7 is not listed here use the a0-numbered calls
+// in handleEcall. Paths go to the host unchanged: the guest can open, create
+// and truncate any file the emulator can.
+
+enum SysNum {
+  SYS_openat = 56,
+  SYS_close  = 57,
+  SYS_lseek  = 62,
+  SYS_read   = 63,
+  SYS_write  = 64,
+  SYS_writev = 66,
+  SYS_fstat  = 80,
+  SYS_exit   = 93,
+  SYS_brk    = 214,
+  SYS_open   = 1024,
+};
+
+#define SYS_FD_MAX 16  // Guest file descriptors; 0-2 are the host's stdio.
+#define SYS_STAT_SIZE 128  // rv32 kernel_stat filled by fstat.
+
+// Close guest files and set the initial program break (end of the image).
+void sysReset(uint32_t brk);
+
+// Guest files and program break, saved and restored around fuzz inputs.
+// Open files are held as host dups with their offsets, so they survive the
+// guest closing them.
+typedef struct SysState {
+  int fd[SYS_FD_MAX];
+  int64_t off[SYS_FD_MAX];
+  uint32_t brk_start, brk;
+} SysState;
+
+void sysSave(SysState *s);
+// Closes files opened since sysSave and reopens the saved ones; s stays
+// valid for further restores.
+void sysRestore(const SysState *s);
+
+// Name of syscall num, or NULL if it is not a newlib call.
+const char* sysName(uint32_t num);
+
+// Run the call in x[a7]. x is the scalar register file; the heap may grow
+// up to the guest stack pointer. Returns true if the guest exited, with the
+// status in x[a0].
+bool sysCall(uint32_t *x, uint8_t *mem, uint32_t mem_size);
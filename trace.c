@@ -0,0 +1,94 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sym.h"
+#include "trace.h"
+
+FILE* trace_file = NULL;
+uint32_t trace_ret[TRACE_DEPTH];  // Expected return addresses.
+int trace_depth = 0;
+int trace_lost = 0;  // Calls beyond TRACE_DEPTH, not traced.
+uint64_t trace_end = 0;  // Time of the last flush.
+
+// Write a JSON string, escaping the few characters symbol names might hold.
+void traceStr(const char* s) {
+  fputc('"', trace_file);
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\') fputc('\\', trace_file);
+    fputc(*s, trace_file);
+  }
+  fputc('"', trace_file);
+}
+
+void traceBegin(uint32_t addr, uint64_t now) {
+  fputs(",\n{\"ph\":\"B\",\"pid\":1,\"tid\":1,\"ts\":", trace_file);
+  fprintf(trace_file, "%llu,\"name\":", (unsigned long long)now);
+  traceStr(symName(addr));
+  fprintf(trace_file, ",\"args\":{\"addr\":\"0x%x\"}}", addr);
+}
+
+void traceEnd(uint64_t now) {
+  fprintf(trace_file, ",\n{\"ph\":\"E\",\"pid\":1,\"tid\":1,\"ts\":%llu}",
+          (unsigned long long)now);
+}
+
+// Process exit: end open frames and the array.
+void traceClose() {
+  if (!trace_file) return;
+  for (; trace_depth > 0; --trace_depth) traceEnd(trace_end);
+  fputs("\n]\n", trace_file);
+  fclose(trace_file);
+  trace_file = NULL;
+}
+
+void traceReset(uint32_t entry) {
+  static bool registered = false;
+  if (!registered) registered = atexit(traceClose) == 0;
+  if (trace_file) fclose(trace_file);
+  trace_file = fopen(TRACE_FILE, "w");
+  if (!trace_file) return;
+  setvbuf(trace_file, NULL, _IOFBF, TRACE_BUF_SIZE);
+  // JSON array format: viewers accept the file even if the run never exits.
+  fputs("[{\"ph\":\"M\",\"pid\":1,\"tid\":1,\"name\":\"thread_name\","
+        "\"args\":{\"name\":\"guest\"}}", trace_file);
+  trace_depth = 1;
+  trace_lost = 0;
+  trace_ret[0] = 0;
+  traceBegin(entry, 0);
+}
+
+void traceCall(uint32_t target, uint32_t ret, uint64_t now) {
+  if (!trace_file) return;
+  if (trace_depth == TRACE_DEPTH) {
+    ++trace_lost;
+    return;
+  }
+  trace_ret[trace_depth++] = ret;
+  traceBegin(target, now);
+}
+
+void traceReturn(uint32_t target, uint64_t now) {
+  if (!trace_file) return;
+  // Unwind to the frame expecting this return address, if any.
+  int d = trace_depth - 1;
+  while (d > 0 && trace_ret[d] != target) --d;
+  if (d == 0) return;
+  for (; trace_depth > d; --trace_depth) traceEnd(now);
+}
+
+void traceInstant(const char* name, int32_t arg, uint64_t now) {
+  if (!trace_file) return;
+  fputs(",\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":1,\"ts\":", trace_file);
+  fprintf(trace_file, "%llu,\"name\":", (unsigned long long)now);
+  traceStr(name);
+  fprintf(trace_file, ",\"args\":{\"a0\":%d}}", arg);
+}
+
+void traceFlush(uint64_t now) {
+  if (!trace_file) return;
+  trace_end = now;
+  fflush(trace_file);
+  if (trace_lost) printf("%d calls not traced (stack full)\n", trace_lost);
+  printf("Call timeline written to %s\n", TRACE_FILE);
+}
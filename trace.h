@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+// Chrome trace-event export of the guest call timeline, enabled with
+// -DCALL_TRACE. Function entry/exit become B/E events and ecalls/ebreaks
+// become instant events, timestamped with the retired-instruction count
+// (shown as microseconds by the viewer). Open the file in chrome://tracing
+// or ui.perfetto.dev. Events are streamed through a large stdio buffer.
+
+#ifndef TRACE_FILE
+#define TRACE_FILE "trace.json"
+#endif
+#ifndef TRACE_DEPTH
+#define TRACE_DEPTH 1024
+#endif
+#ifndef TRACE_BUF_SIZE
+#define TRACE_BUF_SIZE (1 << 20)
+#endif
+
+// Start a new trace rooted at the entry point.
+void traceReset(uint32_t entry);
+
+void traceCall(uint32_t target, uint32_t ret, uint64_t now);
+
+void traceReturn(uint32_t target, uint64_t now);
+
+// Instant event, e.g. "ecall" with its number in a0, or a newlib call
+// such as "write" with its first argument.
+void traceInstant(const char* name, int32_t arg, uint64_t now);
+
+// Flush the file when the guest exits. The trace stays open, as the guest
+// may run on (reverse stepping, further fuzz inputs); open frames are ended
+// at the last flush when the process exits.
+void traceFlush(uint64_t now);
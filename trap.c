@@ -0,0 +1,231 @@
+#include "trap.h"
+
+#include <string.h>
+
+#ifdef MMU
+#include "mmu.h"
+#define MMU_CONTEXT() mmuContext()
+#else
+#define MMU_CONTEXT() ((void)0)
+#endif
+
+// RV32 IMFDCV; S- and U-mode.
+#define MISA ((1u << 30) | (1u << ('I' - 'A')) | (1u << ('M' - 'A')) | \
+              (1u << ('F' - 'A')) | (1u << ('D' - 'A')) |              \
+              (1u << ('C' - 'A')) | (1u << ('V' - 'A')) |              \
+              (1u << ('S' - 'A')) | (1u << ('U' - 'A')))
+#define MIP_SSIP (1u << IRQ_SSI)
+#define MIP_MSIP (1u << IRQ_MSI)
+#define MIP_STIP (1u << IRQ_STI)
+#define MIP_MTIP (1u << IRQ_MTI)
+#define MIP_S (MIP_SSIP | MIP_STIP)
+#define SSTATUS_MASK (MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_SPP | \
+                      MSTATUS_SUM | MSTATUS_MXR)
+#define MSTATUS_MASK (SSTATUS_MASK | MSTATUS_MIE | MSTATUS_MPIE | MSTATUS_MPP)
+// Exceptions 0-9, 12, 13 and 15 can go to S-mode; not ECALL from M-mode.
+#define MEDELEG_MASK 0xb3ffu
+
+TrapState trap;
+uint64_t trap_poll_at = 0;
+
+void trapReset() {
+  memset(&trap, 0, sizeof(trap));
+  trap.priv = PRIV_M;
+  trap.mstatus = MSTATUS_MPP;  // MPP = M.
+  trap.mtimecmp = UINT64_MAX;
+  trap_poll_at = 0;
+}
+
+bool trapCsrRead(uint32_t csr, uint32_t *val) {
+  if (((csr >> 8) & 3) > trap.priv) return false;
+  switch (csr) {
+    case CSR_SSTATUS:  *val = trap.mstatus & SSTATUS_MASK; break;
+    case CSR_SIE:      *val = trap.mie & trap.mideleg; break;
+    case CSR_STVEC:    *val = trap.stvec; break;
+    case CSR_SSCRATCH: *val = trap.sscratch; break;
+    case CSR_SEPC:     *val = trap.sepc; break;
+    case CSR_SCAUSE:   *val = trap.scause; break;
+    case CSR_STVAL:    *val = trap.stval; break;
+    case CSR_SIP:      *val = trap.mip & trap.mideleg; break;
+    case CSR_SATP:     *val = trap.satp; break;
+    case CSR_MSTATUS:  *val = trap.mstatus; break;
+    case CSR_MISA:     *val = MISA; break;
+    case CSR_MEDELEG:  *val = trap.medeleg; break;
+    case CSR_MIDELEG:  *val = trap.mideleg; break;
+    case CSR_MIE:      *val = trap.mie; break;
+    case CSR_MTVEC:    *val = trap.mtvec; break;
+    case CSR_MSCRATCH: *val = trap.mscratch; break;
+    case CSR_MEPC:     *val = trap.mepc; break;
+    case CSR_MCAUSE:   *val = trap.mcause; break;
+    case CSR_MTVAL:    *val = trap.mtval; break;
+    case CSR_MIP:      *val = trap.mip; break;
+    case CSR_MHARTID:  *val = 0; break;
+    default: return false;
+  }
+  return true;
+}
+
+bool trapCsrWrite(uint32_t csr, uint32_t val) {
+  if (((csr >> 8) & 3) > trap.priv) return false;
+  switch (csr) {
+    case CSR_SSTATUS:
+      trap.mstatus = (trap.mstatus & ~SSTATUS_MASK) | (val & SSTATUS_MASK);
+      break;
+    case CSR_SIE:
+      trap.mie = (trap.mie & ~trap.mideleg) | (val & trap.mideleg);
+      break;
+    case CSR_STVEC:    trap.stvec = val & ~2u; break;
+    case CSR_SSCRATCH: trap.sscratch = val; break;
+    case CSR_SEPC:     trap.sepc = val & ~1u; break;
+    case CSR_SCAUSE:   trap.scause = val; break;
+    case CSR_STVAL:    trap.stval = val; break;
+    case CSR_SIP: {
+      uint32_t mask = MIP_SSIP & trap.mideleg;
+      trap.mip = (trap.mip & ~mask) | (val & mask);
+      break;
+    }
+    case CSR_SATP:
+#ifdef MMU
+      trap.satp = val & (SATP_MODE | SATP_PPN);  // No ASID bits.
+#else
+      if (!(val & SATP_MODE)) trap.satp = val & SATP_PPN;  // Bare only.
+#endif
+      break;
+    case CSR_MSTATUS: {
+      uint32_t mpp = val & MSTATUS_MPP;
+      if (mpp == (2u << 11)) mpp = 0;  // Reserved: U.
+      trap.mstatus = (val & MSTATUS_MASK & ~MSTATUS_MPP) | mpp;
+      break;
+    }
+    case CSR_MISA:     break;  // Fixed.
+    case CSR_MEDELEG:  trap.medeleg = val & MEDELEG_MASK; break;
+    case CSR_MIDELEG:  trap.mideleg = val & MIP_S; break;
+    case CSR_MIE:
+      trap.mie = val & (MIP_S | MIP_MSIP | MIP_MTIP);
+      break;
+    case CSR_MTVEC:    trap.mtvec = val & ~2u; break;  // Direct or vectored.
+    case CSR_MSCRATCH: trap.mscratch = val; break;
+    case CSR_MEPC:     trap.mepc = val & ~1u; break;
+    case CSR_MCAUSE:   trap.mcause = val; break;
+    case CSR_MTVAL:    trap.mtval = val; break;
+    case CSR_MIP:  // MSIP and MTIP come from the CLINT.
+      trap.mip = (trap.mip & ~MIP_S) | (val & MIP_S);
+      break;
+    default: return false;
+  }
+  MMU_CONTEXT();     // satp, SUM or MXR may have changed.
+  trap_poll_at = 0;  // An interrupt may have become takeable.
+  return true;
+}
+
+uint32_t trapEnter(uint32_t cause, uint32_t tval, uint32_t pc) {
+  uint32_t code = cause & ~CAUSE_INTERRUPT;
+  uint32_t deleg = cause & CAUSE_INTERRUPT ? trap.mideleg : trap.medeleg;
+  uint32_t tvec;
+  if (trap.priv <= PRIV_S && code < 32 && (deleg >> code) & 1) {
+    trap.sepc = pc;
+    trap.scause = cause;
+    trap.stval = tval;
+    uint32_t sie = trap.mstatus & MSTATUS_SIE;
+    trap.mstatus &= ~(MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_SPP);
+    trap.mstatus |= (sie ? MSTATUS_SPIE : 0) | (trap.priv ? MSTATUS_SPP : 0);
+    trap.priv = PRIV_S;
+    tvec = trap.stvec;
+  } else {
+    trap.mepc = pc;
+    trap.mcause = cause;
+    trap.mtval = tval;
+    uint32_t mie = trap.mstatus & MSTATUS_MIE;
+    trap.mstatus &= ~(MSTATUS_MIE | MSTATUS_MPIE | MSTATUS_MPP);
+    trap.mstatus |= (mie ? MSTATUS_MPIE : 0) | (trap.priv << 11);
+    trap.priv = PRIV_M;
+    tvec = trap.mtvec;
+  }
+  MMU_CONTEXT();
+  uint32_t base = tvec & ~3u;
+  if ((tvec & 1) && (cause & CAUSE_INTERRUPT))  // Vectored.
+    return base + 4 * code;
+  return base;
+}
+
+uint32_t trapMret() {
+  trap.priv = (trap.mstatus & MSTATUS_MPP) >> 11;
+  trap.mstatus &= ~(MSTATUS_MIE | MSTATUS_MPP);
+  if (trap.mstatus & MSTATUS_MPIE) trap.mstatus |= MSTATUS_MIE;
+  trap.mstatus |= MSTATUS_MPIE;  // MPP = U.
+  MMU_CONTEXT();
+  trap_poll_at = 0;
+  return trap.mepc;
+}
+
+uint32_t trapSret() {
+  trap.priv = trap.mstatus & MSTATUS_SPP ? PRIV_S : PRIV_U;
+  trap.mstatus &= ~(MSTATUS_SIE | MSTATUS_SPP);
+  if (trap.mstatus & MSTATUS_SPIE) trap.mstatus |= MSTATUS_SIE;
+  trap.mstatus |= MSTATUS_SPIE;  // SPP = U.
+  MMU_CONTEXT();
+  trap_poll_at = 0;
+  return trap.sepc;
+}
+
+bool trapPending(uint64_t now) {
+  if (now >= trap.mtimecmp) trap.mip |= MIP_MTIP;
+  else trap.mip &= ~MIP_MTIP;
+  return trap.mip & trap.mie;
+}
+
+uint32_t trapInterrupt() {
+  static const uint32_t order[] = {IRQ_MSI, IRQ_MTI, IRQ_SSI, IRQ_STI};
+  uint32_t pending = trap.mip & trap.mie;
+  if (!pending) return 0;
+  // M-level interrupts are masked by MIE only in M-mode, S-level ones by
+  // SIE only in S-mode, and never below their level.
+  bool m_on = trap.priv < PRIV_M || (trap.mstatus & MSTATUS_MIE);
+  bool s_on = trap.priv < PRIV_S ||
+              (trap.priv == PRIV_S && (trap.mstatus & MSTATUS_SIE));
+  uint32_t irq = (m_on ? pending & ~trap.mideleg : 0) |
+                 (s_on ? pending & trap.mideleg : 0);
+  for (uint32_t i = 0; i < sizeof(order) / sizeof(order[0]); ++i)
+    if (irq & (1u << order[i])) return CAUSE_INTERRUPT | order[i];
+  return 0;
+}
+
+uint64_t trapDeadline() {
+  return trap.mie & MIP_MTIP ? trap.mtimecmp : UINT64_MAX;
+}
+
+bool clintLoad(uint32_t addr, uint32_t *val, uint64_t now) {
+  switch (addr) {
+    case CLINT_MSIP:         *val = (trap.mip & MIP_MSIP) != 0; break;
+    case CLINT_MTIMECMP:     *val = trap.mtimecmp; break;
+    case CLINT_MTIMECMP + 4: *val = trap.mtimecmp >> 32; break;
+    case CLINT_MTIME:        *val = now; break;
+    case CLINT_MTIME + 4:    *val = now >> 32; break;
+    default: return false;
+  }
+  return true;
+}
+
+bool clintStore(uint32_t addr, uint32_t val, uint64_t now) {
+  uint64_t t;
+  switch (addr) {
+    case CLINT_MSIP:
+      trap.mip = (trap.mip & ~MIP_MSIP) | (val & 1 ? MIP_MSIP : 0);
+      break;
+    case CLINT_MTIMECMP:
+      trap.mtimecmp = (trap.mtimecmp & ~0xffffffffull) | val;
+      break;
+    case CLINT_MTIMECMP + 4:
+      trap.mtimecmp = (trap.mtimecmp & 0xffffffffull) | (uint64_t)val << 32;
+      break;
+    case CLINT_MTIME:
+    case CLINT_MTIME + 4:
+      t = addr == CLINT_MTIME ? (now & ~0xffffffffull) | val
+                              : (now & 0xffffffffull) | (uint64_t)val << 32;
+      trap.mtime_offset += t - now;
+      break;
+    default: return false;
+  }
+  trap_poll_at = 0;
+  return true;
+}
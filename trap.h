@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Machine-mode traps and a CLINT timer, enabled with -DTRAPS.
+// Implements mstatus (MIE, MPIE, MPP), mie/mip (MSI, MTI), mtvec (direct
+// and vectored), mepc, mcause, mtval, mscratch, mret and wfi. Interrupts
+// are checked every TRAP_POLL instructions and right after any write that
+// can make one takeable.
+//
+// Supervisor mode: medeleg/mideleg, the s* CSRs (sstatus with SIE, SPIE,
+// SPP, SUM, MXR; sie/sip with SSI and STI, which M-mode software raises
+// through mip), sret and satp. satp only accepts Sv32 when built with
+// -DMMU (see mmu.h); otherwise it is Bare. There are no ASIDs and no MPRV.
+//
+// A guest that leaves mtvec at 0 keeps the old behaviour: faults stop it.
+// ECALL from M-mode stays the host call interface (newlib system calls and
+// the a0-numbered calls); from U-mode it traps.
+//
+// The CLINT sits at the start of the IO region after guest memory, with a
+// compact layout of 32-bit registers:
+//   CLINT_MSIP      software interrupt pending (bit 0)
+//   CLINT_MTIMECMP  64-bit timer compare, low word first
+//   CLINT_MTIME     64-bit time in us, the same clock as the time CSR
+// With -DVIRTUAL_TIME=n time advances 1 us per n retired instructions and
+// WFI jumps straight to the next timer deadline; otherwise time is the host
+// clock and WFI sleeps the host thread until then.
+
+#define IO_START 0x100000
+#define IO_SIZE  0x1000  // 4KiB
+#define CLINT_MSIP     (IO_START + 0x0)
+#define CLINT_MTIMECMP (IO_START + 0x8)
+#define CLINT_MTIME    (IO_START + 0x10)
+
+#ifndef TRAP_POLL
+#define TRAP_POLL 1024  // Retired instructions between timer checks.
+#endif
+#ifndef WFI_SLICE_US
+#define WFI_SLICE_US 10000  // Longest host wait in WFI, between reset checks.
+#endif
+
+enum TrapCause {
+  CAUSE_FETCH_ACCESS     = 1,
+  CAUSE_ILLEGAL_INST     = 2,
+  CAUSE_LOAD_MISALIGNED  = 4,
+  CAUSE_LOAD_ACCESS      = 5,
+  CAUSE_STORE_MISALIGNED = 6,
+  CAUSE_STORE_ACCESS     = 7,
+  CAUSE_ECALL_U          = 8,  // + privilege level of the caller.
+  CAUSE_ECALL_M          = 11,
+  CAUSE_FETCH_PAGE_FAULT = 12,
+  CAUSE_LOAD_PAGE_FAULT  = 13,
+  CAUSE_STORE_PAGE_FAULT = 15,
+  CAUSE_INTERRUPT        = 0x80000000,
+};
+enum TrapIrq { IRQ_SSI = 1, IRQ_MSI = 3, IRQ_STI = 5, IRQ_MTI = 7 };
+
+enum TrapCsrAddr {
+  CSR_SSTATUS  = 0x100,
+  CSR_SIE      = 0x104,
+  CSR_STVEC    = 0x105,
+  CSR_SSCRATCH = 0x140,
+  CSR_SEPC     = 0x141,
+  CSR_SCAUSE   = 0x142,
+  CSR_STVAL    = 0x143,
+  CSR_SIP      = 0x144,
+  CSR_SATP     = 0x180,
+  CSR_MSTATUS  = 0x300,
+  CSR_MISA     = 0x301,
+  CSR_MEDELEG  = 0x302,
+  CSR_MIDELEG  = 0x303,
+  CSR_MIE      = 0x304,
+  CSR_MTVEC    = 0x305,
+  CSR_MSCRATCH = 0x340,
+  CSR_MEPC     = 0x341,
+  CSR_MCAUSE   = 0x342,
+  CSR_MTVAL    = 0x343,
+  CSR_MIP      = 0x344,
+  CSR_MHARTID  = 0xF14,
+};
+
+#define MSTATUS_SIE  (1u << 1)
+#define MSTATUS_MIE  (1u << 3)
+#define MSTATUS_SPIE (1u << 5)
+#define MSTATUS_MPIE (1u << 7)
+#define MSTATUS_SPP  (1u << 8)
+#define MSTATUS_MPP  (3u << 11)
+#define MSTATUS_SUM  (1u << 18)  // S-mode may access U pages.
+#define MSTATUS_MXR  (1u << 19)  // Loads may read execute-only pages.
+
+#define SATP_MODE (1u << 31)  // Sv32.
+#define SATP_PPN  0x3fffffu   // Root page table >> 12.
+
+enum TrapPriv { PRIV_U = 0, PRIV_S = 1, PRIV_M = 3 };
+
+// Trap CSRs and CLINT registers.
+typedef struct {
+  uint32_t priv;  // Current privilege level.
+  uint32_t mstatus, mie, mip, mtvec, mscratch, mepc, mcause, mtval;
+  uint32_t medeleg, mideleg, stvec, sscratch, sepc, scause, stval, satp;
+  uint64_t mtimecmp;
+  uint64_t mtime_offset;  // Added to the clock: mtime writes, WFI skips.
+} TrapState;
+
+extern TrapState trap;
+extern uint64_t trap_poll_at;  // Instret of the next interrupt check.
+
+#define TRAP_DUE(instret) ((instret) >= trap_poll_at)
+
+void trapReset();
+
+// Trap CSR access, including the privilege check. Return false if the CSR
+// does not exist, is read-only, or is above the current privilege level.
+bool trapCsrRead(uint32_t csr, uint32_t *val);
+bool trapCsrWrite(uint32_t csr, uint32_t val);
+
+// Enter the handler for cause (CAUSE_INTERRUPT set for interrupts) raised
+// by the instruction at pc, in S-mode if delegated. Returns the handler
+// address.
+uint32_t trapEnter(uint32_t cause, uint32_t tval, uint32_t pc);
+
+// Return from a machine-mode handler. Returns mepc.
+uint32_t trapMret();
+
+// Return from a supervisor-mode handler. Returns sepc.
+uint32_t trapSret();
+
+// Update MTIP for time now (us). Returns true if an enabled interrupt is
+// pending, which wakes WFI even with interrupts globally disabled.
+bool trapPending(uint64_t now);
+
+// Interrupt cause to take now, or 0.
+uint32_t trapInterrupt();
+
+// Time at which the timer interrupt becomes pending, UINT64_MAX if it is
+// disabled.
+uint64_t trapDeadline();
+
+// 32-bit CLINT access at time now. Return false if addr is not a CLINT
+// register.
+bool clintLoad(uint32_t addr, uint32_t *val, uint64_t now);
+bool clintStore(uint32_t addr, uint32_t val, uint64_t now);
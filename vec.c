@@ -0,0 +1,377 @@
+#include "vec.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Host SIMD chunk: one AVX2 register when compiled with -mavx2, otherwise one
+// SSE register. GCC vector types lower to scalar code on hosts without SIMD.
+#ifdef __AVX2__
+#define VEC_CHUNK 32
+#else
+#define VEC_CHUNK 16
+#endif
+
+typedef uint8_t vu8 __attribute__((vector_size(VEC_CHUNK)));
+typedef int8_t vs8 __attribute__((vector_size(VEC_CHUNK)));
+typedef uint16_t vu16 __attribute__((vector_size(VEC_CHUNK)));
+typedef int16_t vs16 __attribute__((vector_size(VEC_CHUNK)));
+typedef uint32_t vu32 __attribute__((vector_size(VEC_CHUNK)));
+typedef int32_t vs32 __attribute__((vector_size(VEC_CHUNK)));
+
+#define GROUP_MAX (8 * VLENB)  // Largest register group (LMUL=8).
+#define VILL 0x80000000u
+
+// Register file. A group of LMUL registers is contiguous, so group ops index
+// it linearly. Padded so a chunk starting inside v31 can be read whole.
+uint8_t vreg[32 * VLENB + VEC_CHUNK];
+uint8_t vtmp[GROUP_MAX + VEC_CHUNK];    // Arithmetic result before commit.
+uint8_t vsplat[GROUP_MAX + VEC_CHUNK];  // Scalar/immediate operand broadcast.
+
+uint32_t vl = 0;
+uint32_t vtype = VILL;  // Illegal until the first vsetvl.
+
+#define VREG(r) (&vreg[(r) * VLENB])
+// Group of n bytes starting at register r stays inside the register file.
+#define VEC_FITS(r, n) ((r) * VLENB + (n) <= 32 * VLENB)
+#define MASK_BIT(i) ((vreg[(i) >> 3] >> ((i) & 7)) & 1)  // v0.t
+#define FIELD(x, hi, lo) (((x) >> (lo)) & ((1u << ((hi) - (lo) + 1)) - 1))
+#define SEW_BYTES() (1u << FIELD(vtype, 5, 3))
+
+void vecReset() {
+  memset(vreg, 0, sizeof(vreg));
+  vl = 0;
+  vtype = VILL;
+}
+
+bool vecCsrRead(uint32_t csr, uint32_t *val) {
+  switch (csr) {
+    case CSR_VL:    *val = vl; break;
+    case CSR_VTYPE: *val = vtype; break;
+    case CSR_VLENB: *val = VLENB; break;
+    default: return false;
+  }
+  return true;
+}
+
+// Element i of width eb bytes (little-endian host and guest).
+uint32_t elemGet(const uint8_t *p, uint32_t i, uint32_t eb) {
+  uint32_t v = 0;
+  memcpy(&v, p + i * eb, eb);
+  return v;
+}
+
+void elemSet(uint8_t *p, uint32_t i, uint32_t eb, uint32_t v) {
+  memcpy(p + i * eb, &v, eb);
+}
+
+int32_t elemSext(uint32_t v, uint32_t eb) {
+  return (int32_t)(v << (32 - 8 * eb)) >> (32 - 8 * eb);
+}
+
+// VLMAX for a vtype, or 0 if the vtype is unsupported (SEW > ELEN=32,
+// reserved LMUL, fractional LMUL too small for SEW, or reserved bits set).
+uint32_t vecVlmax(uint32_t type) {
+  uint32_t vsew = FIELD(type, 5, 3), vlmul = FIELD(type, 2, 0);
+  if (type >> 8 || vsew > 2 || vlmul == 4) return 0;
+  uint32_t per_reg = VLENB >> vsew;
+  if (vlmul < 4) return per_reg << vlmul;
+  if ((8u << vsew) > (32u >> (8 - vlmul))) return 0;  // SEW > LMUL * ELEN
+  return per_reg >> (8 - vlmul);
+}
+
+void vecSetVl(uint32_t rd, uint32_t rs1, uint32_t avl, uint32_t type,
+              uint32_t *x) {
+  uint32_t vlmax = vecVlmax(type);
+  if (vlmax == 0) {
+    vtype = VILL;
+    vl = 0;
+  } else {
+    // rs1 = x0: rd != x0 requests VLMAX, rd = x0 keeps the current vl.
+    if (rs1 == 0) avl = rd != 0 ? UINT32_MAX : vl;
+    vtype = type;
+    vl = avl < vlmax ? avl : vlmax;
+  }
+  x[rd] = vl;
+}
+
+enum FpMemStatus vecLoadStore(uint32_t inst, uint32_t *x, uint8_t *mem,
+                              uint32_t mem_size, uint32_t *fault,
+                              char *out_op) {
+  static const uint8_t width_bytes[8] = {1, 0, 0, 0, 0, 2, 4, 8};
+  bool store = FIELD(inst, 5, 5);
+  uint32_t vd = FIELD(inst, 11, 7), rs1 = FIELD(inst, 19, 15);
+  uint32_t rs2 = FIELD(inst, 24, 20), mop = FIELD(inst, 27, 26);
+  bool masked = !FIELD(inst, 25, 25);
+  uint32_t eb = width_bytes[FIELD(inst, 14, 12)];
+  uint32_t n = vl * eb;
+  // Segment (nf), indexed (mop odd), whole-register/mask (lumop) and 64-bit
+  // forms are outside the subset.
+  if (FIELD(inst, 31, 28) || (mop & 1) || (mop == 0 && rs2 != 0) || eb == 8 ||
+      (vtype & VILL) || !VEC_FITS(vd, n)) {
+    sprintf(out_op, "unknown vector %s", store ? "store" : "load");
+    return FP_MEM_ILLEGAL;
+  }
+  uint32_t base = x[rs1];
+  uint32_t stride = mop == 0b10 ? x[rs2] : eb;
+  uint8_t *v = VREG(vd);
+
+  if (mop == 0b10)
+    sprintf(out_op, "v%sse%d.v v%d, (x%d), x%d%s", store ? "s" : "l", 8 * eb,
+            vd, rs1, rs2, masked ? ", v0.t" : "");
+  else
+    sprintf(out_op, "v%se%d.v v%d, (x%d)%s", store ? "s" : "l", 8 * eb, vd,
+            rs1, masked ? ", v0.t" : "");
+
+  // Check every active element before touching memory or registers.
+  for (uint32_t i = 0; i < vl; ++i) {
+    uint32_t addr = base + i * stride;
+    if (masked && !MASK_BIT(i)) continue;
+    if (addr > mem_size - eb) {
+      *fault = addr;
+      return FP_MEM_FAULT;
+    }
+  }
+  if (!masked && stride == eb) {  // Unit stride: one host block copy.
+    if (store) memcpy(&mem[base], v, n);
+    else memcpy(v, &mem[base], n);
+    return FP_MEM_OK;
+  }
+  for (uint32_t i = 0; i < vl; ++i) {
+    if (masked && !MASK_BIT(i)) continue;
+    uint8_t *m = &mem[base + i * stride];
+    if (store) memcpy(m, v + i * eb, eb);
+    else memcpy(v + i * eb, m, eb);
+  }
+  return FP_MEM_OK;
+}
+
+// Element-wise ops with a SIMD body (V_ADD..V_MACC), then compares and
+// reductions, which go element by element.
+enum VecAlu {
+  V_NONE, V_ADD, V_SUB, V_RSUB, V_MINU, V_MIN, V_MAXU, V_MAX, V_AND, V_OR,
+  V_XOR, V_MERGE, V_SLL, V_SRL, V_SRA, V_MUL, V_MACC,
+  V_SEQ, V_SNE, V_SLTU, V_SLT, V_SLEU, V_SLE, V_SGTU, V_SGT,
+  V_RSUM, V_RAND, V_ROR, V_RXOR, V_RMINU, V_RMIN, V_RMAXU, V_RMAX,
+  V_MVXS,  // vmv.x.s / vmv.s.x
+};
+
+typedef struct VecOpInfo {
+  uint8_t alu;
+  const char *name;
+} VecOpInfo;
+
+// Integer (OPIVV/OPIVX/OPIVI) ops by funct6.
+const VecOpInfo vec_opi[64] = {
+  [0b000000] = {V_ADD, "vadd"},   [0b000010] = {V_SUB, "vsub"},
+  [0b000011] = {V_RSUB, "vrsub"}, [0b000100] = {V_MINU, "vminu"},
+  [0b000101] = {V_MIN, "vmin"},   [0b000110] = {V_MAXU, "vmaxu"},
+  [0b000111] = {V_MAX, "vmax"},   [0b001001] = {V_AND, "vand"},
+  [0b001010] = {V_OR, "vor"},     [0b001011] = {V_XOR, "vxor"},
+  [0b010111] = {V_MERGE, "vmerge"},
+  [0b011000] = {V_SEQ, "vmseq"},  [0b011001] = {V_SNE, "vmsne"},
+  [0b011010] = {V_SLTU, "vmsltu"}, [0b011011] = {V_SLT, "vmslt"},
+  [0b011100] = {V_SLEU, "vmsleu"}, [0b011101] = {V_SLE, "vmsle"},
+  [0b011110] = {V_SGTU, "vmsgtu"}, [0b011111] = {V_SGT, "vmsgt"},
+  [0b100101] = {V_SLL, "vsll"},   [0b101000] = {V_SRL, "vsrl"},
+  [0b101001] = {V_SRA, "vsra"},
+};
+
+// Multiply/reduction (OPMVV/OPMVX) ops by funct6.
+const VecOpInfo vec_opm[64] = {
+  [0b000000] = {V_RSUM, "vredsum"},   [0b000001] = {V_RAND, "vredand"},
+  [0b000010] = {V_ROR, "vredor"},     [0b000011] = {V_RXOR, "vredxor"},
+  [0b000100] = {V_RMINU, "vredminu"}, [0b000101] = {V_RMIN, "vredmin"},
+  [0b000110] = {V_RMAXU, "vredmaxu"}, [0b000111] = {V_RMAX, "vredmax"},
+  [0b010000] = {V_MVXS, "vmv"},
+  [0b100101] = {V_MUL, "vmul"},       [0b101101] = {V_MACC, "vmacc"},
+};
+
+// One SIMD chunk at a time over n bytes: a = vs2, b = vs1/scalar, d = vd.
+#define VEC_LOOP(T, expr)                                        \
+  for (uint32_t i = 0; i < n; i += VEC_CHUNK) {                  \
+    T a, b, d, r;                                                \
+    memcpy(&a, s2 + i, VEC_CHUNK);                               \
+    memcpy(&b, s1 + i, VEC_CHUNK);                               \
+    memcpy(&d, dst + i, VEC_CHUNK);                              \
+    expr;                                                        \
+    memcpy(vtmp + i, &r, VEC_CHUNK);                             \
+  }                                                              \
+  break;
+
+// U/S: unsigned/signed vector types of one SEW, BITS: SEW.
+#define VEC_ALU(U, S, BITS)                                                  \
+  switch (alu) {                                                             \
+    case V_ADD:   VEC_LOOP(U, r = a + b)                                     \
+    case V_SUB:   VEC_LOOP(U, r = a - b)                                     \
+    case V_RSUB:  VEC_LOOP(U, r = b - a)                                     \
+    case V_MINU:  VEC_LOOP(U, U m = (U)(a < b); r = (a & m) | (b & ~m))      \
+    case V_MIN:   VEC_LOOP(U, U m = (U)((S)a < (S)b); r = (a & m) | (b & ~m)) \
+    case V_MAXU:  VEC_LOOP(U, U m = (U)(a > b); r = (a & m) | (b & ~m))      \
+    case V_MAX:   VEC_LOOP(U, U m = (U)((S)a > (S)b); r = (a & m) | (b & ~m)) \
+    case V_AND:   VEC_LOOP(U, r = a & b)                                     \
+    case V_OR:    VEC_LOOP(U, r = a | b)                                     \
+    case V_XOR:   VEC_LOOP(U, r = a ^ b)                                     \
+    case V_MERGE: VEC_LOOP(U, r = b)                                         \
+    case V_SLL:   VEC_LOOP(U, r = a << (b & (BITS - 1)))                     \
+    case V_SRL:   VEC_LOOP(U, r = a >> (b & (BITS - 1)))                     \
+    case V_SRA:   VEC_LOOP(U, r = (U)((S)a >> (S)(b & (BITS - 1))))          \
+    case V_MUL:   VEC_LOOP(U, r = a * b)                                     \
+    case V_MACC:  VEC_LOOP(U, r = a * b + d)                                 \
+  }
+
+// Compare elements of vs2 (a) and operand (b) into mask bit i of vd.
+bool vecCompare(uint32_t alu, uint32_t a, uint32_t b, uint32_t eb) {
+  int32_t sa = elemSext(a, eb), sb = elemSext(b, eb);
+  switch (alu) {
+    case V_SEQ:  return a == b;
+    case V_SNE:  return a != b;
+    case V_SLTU: return a < b;
+    case V_SLT:  return sa < sb;
+    case V_SLEU: return a <= b;
+    case V_SLE:  return sa <= sb;
+    case V_SGTU: return a > b;
+    default:     return sa > sb;  // V_SGT
+  }
+}
+
+uint32_t vecReduce(uint32_t alu, uint32_t acc, uint32_t v, uint32_t eb) {
+  int32_t sacc = elemSext(acc, eb), sv = elemSext(v, eb);
+  switch (alu) {
+    case V_RSUM:  return acc + v;
+    case V_RAND:  return acc & v;
+    case V_ROR:   return acc | v;
+    case V_RXOR:  return acc ^ v;
+    case V_RMINU: return v < acc ? v : acc;
+    case V_RMIN:  return sv < sacc ? v : acc;
+    case V_RMAXU: return v > acc ? v : acc;
+    default:      return sv > sacc ? v : acc;  // V_RMAX
+  }
+}
+
+bool vecOp(uint32_t inst, uint32_t *x, char *out_op) {
+  uint32_t funct3 = FIELD(inst, 14, 12), funct6 = FIELD(inst, 31, 26);
+  uint32_t vd = FIELD(inst, 11, 7), rs1 = FIELD(inst, 19, 15);
+  uint32_t vs2 = FIELD(inst, 24, 20);
+  bool masked = !FIELD(inst, 25, 25);
+
+  if (funct3 == 0b111) {  // vsetvli / vsetivli / vsetvl
+    if (!FIELD(inst, 31, 31)) {
+      vecSetVl(vd, rs1, x[rs1], FIELD(inst, 30, 20), x);
+      sprintf(out_op, "vsetvli x%d, x%d, 0x%x", vd, rs1, FIELD(inst, 30, 20));
+    } else if (FIELD(inst, 31, 30) == 0b11) {
+      vecSetVl(vd, 1, rs1, FIELD(inst, 29, 20), x);  // AVL is the immediate.
+      sprintf(out_op, "vsetivli x%d, %d, 0x%x", vd, rs1, FIELD(inst, 29, 20));
+    } else if (FIELD(inst, 31, 25) == 0b1000000) {
+      vecSetVl(vd, rs1, x[rs1], x[vs2], x);
+      sprintf(out_op, "vsetvl x%d, x%d, x%d", vd, rs1, vs2);
+    } else {
+      sprintf(out_op, "unknown op-v");
+      return false;
+    }
+    return true;
+  }
+
+  // Operand kind: vector (OPIVV/OPMVV), immediate (OPIVI), scalar (OPIVX/OPMVX).
+  // FP forms are outside the subset.
+  const VecOpInfo *info;
+  const char *suffix;
+  char opnd[12];
+  switch (funct3) {
+    case 0b000: info = &vec_opi[funct6]; suffix = "vv"; break;
+    case 0b010: info = &vec_opm[funct6]; suffix = "vv"; break;
+    case 0b011: info = &vec_opi[funct6]; suffix = "vi"; break;
+    case 0b100: info = &vec_opi[funct6]; suffix = "vx"; break;
+    case 0b110: info = &vec_opm[funct6]; suffix = "vx"; break;
+    default:    info = &vec_opi[0]; suffix = NULL; break;
+  }
+  uint32_t alu = suffix ? info->alu : V_NONE;
+  uint32_t eb = SEW_BYTES(), n = vl * eb;
+  bool vv = suffix && suffix[1] == 'v';
+  // Register groups must stay inside the file. Mask destinations and the
+  // reduction scalars vd[0]/vs1[0] are single registers.
+  bool group_vd = alu < V_SEQ, group_vs1 = vv && alu < V_RSUM;
+  // VWXUNARY0/VRXUNARY0 share funct6 with vcpop.m, vfirst.m and friends:
+  // only the unmasked moves (vs1 = 0 for vmv.x.s, vs2 = 0 for vmv.s.x).
+  bool mv_ok = alu == V_MVXS && !masked && (vv ? rs1 : vs2) == 0;
+  if (alu == V_NONE || (vtype & VILL) || (alu == V_MVXS && !mv_ok) ||
+      (alu != V_MVXS && (!VEC_FITS(vs2, n) || (group_vd && !VEC_FITS(vd, n)) ||
+                         (group_vs1 && !VEC_FITS(rs1, n))))) {
+    sprintf(out_op, "unknown op-v");
+    return false;
+  }
+  int32_t simm5 = elemSext(rs1 << 3, 1) >> 3;
+  if (vv) sprintf(opnd, "v%d", rs1);
+  else if (suffix[1] == 'x') sprintf(opnd, "x%d", rs1);
+  else sprintf(opnd, "%d", simm5);
+
+  uint8_t *dst = VREG(vd);
+  const uint8_t *s2 = VREG(vs2);
+  const uint8_t *s1 = VREG(rs1);
+  if (!vv) {  // Broadcast the scalar/immediate operand.
+    uint32_t val = suffix[1] == 'x' ? x[rs1] : (uint32_t)simm5;
+    for (uint32_t i = 0; i < vl; ++i) elemSet(vsplat, i, eb, val);
+    s1 = vsplat;
+  }
+
+  if (alu == V_MVXS) {
+    if (vv) {  // vmv.x.s: sign-extended element 0.
+      x[vd] = elemSext(elemGet(s2, 0, eb), eb);
+      sprintf(out_op, "vmv.x.s x%d, v%d", vd, vs2);
+    } else {  // vmv.s.x
+      if (vl > 0) elemSet(dst, 0, eb, x[rs1]);
+      sprintf(out_op, "vmv.s.x v%d, x%d", vd, rs1);
+    }
+    return true;
+  }
+  const char *mask_str = masked ? ", v0.t" : "";
+  if (alu >= V_RSUM) {  // vd[0] = fold(vs1[0], active vs2[*])
+    if (vl > 0) {
+      uint32_t acc = elemGet(s1, 0, eb);
+      for (uint32_t i = 0; i < vl; ++i)
+        if (!masked || MASK_BIT(i)) acc = vecReduce(alu, acc, elemGet(s2, i, eb), eb);
+      elemSet(dst, 0, eb, acc);
+    }
+    sprintf(out_op, "%s.vs v%d, v%d, v%d%s", info->name, vd, vs2, rs1, mask_str);
+    return true;
+  }
+  if (alu >= V_SEQ) {  // Mask result: one bit per element, mask-undisturbed.
+    for (uint32_t i = 0; i < vl; ++i) {
+      if (masked && !MASK_BIT(i)) continue;
+      uint8_t bit = 1 << (i & 7);
+      if (vecCompare(alu, elemGet(s2, i, eb), elemGet(s1, i, eb), eb))
+        dst[i >> 3] |= bit;
+      else
+        dst[i >> 3] &= ~bit;
+    }
+    sprintf(out_op, "%s.%s v%d, v%d, %s%s", info->name, suffix, vd, vs2, opnd,
+            mask_str);
+    return true;
+  }
+
+  switch (eb) {
+    case 1: VEC_ALU(vu8, vs8, 8); break;
+    case 2: VEC_ALU(vu16, vs16, 16); break;
+    default: VEC_ALU(vu32, vs32, 32); break;
+  }
+  // Commit the first vl elements; tail elements are left undisturbed.
+  if (alu == V_MERGE && masked) {  // vmerge: inactive elements take vs2.
+    for (uint32_t i = 0; i < vl; ++i)
+      elemSet(dst, i, eb, elemGet(MASK_BIT(i) ? vtmp : s2, i, eb));
+  } else if (masked) {
+    for (uint32_t i = 0; i < vl; ++i)
+      if (MASK_BIT(i)) elemSet(dst, i, eb, elemGet(vtmp, i, eb));
+  } else {
+    memcpy(dst, vtmp, n);
+  }
+
+  if (alu == V_MERGE && masked)
+    sprintf(out_op, "vmerge.%sm v%d, v%d, %s, v0", suffix, vd, vs2, opnd);
+  else if (alu == V_MERGE)
+    sprintf(out_op, "vmv.v.%c v%d, %s", suffix[1], vd, opnd);
+  else if (alu == V_MACC)
+    sprintf(out_op, "vmacc.%s v%d, %s, v%d%s", suffix, vd, opnd, vs2, mask_str);
+  else
+    sprintf(out_op, "%s.%s v%d, v%d, %s%s", info->name, suffix, vd, vs2, opnd,
+            mask_str);
+  return true;
+}
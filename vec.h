@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fpu.h"
+
+// RVV 1.0 subset: vsetvl{i}, unit-stride and strided loads/stores, integer
+// arithmetic, compares, reductions and scalar moves, with SEW 8/16/32
+// (ELEN=32) and LMUL 1/4..8. Unmasked arithmetic runs over whole register
+// groups in host SIMD chunks.
+
+#ifndef VLEN
+#define VLEN 128  // Bits per vector register; -DVLEN=256 for wider registers.
+#endif
+#define VLENB (VLEN / 8)
+
+#define OP_V 0b1010111  // OP-V major opcode; loads/stores share LOAD-FP/STORE-FP.
+
+// Vector CSRs (read-only in this subset).
+enum VecCsrAddr {
+  CSR_VL    = 0xC20,
+  CSR_VTYPE = 0xC21,
+  CSR_VLENB = 0xC22,
+};
+
+extern uint8_t vreg[];  // v0-v31, VLENB bytes each.
+extern uint32_t vl;
+extern uint32_t vtype;
+
+void vecReset();
+
+bool vecCsrRead(uint32_t csr, uint32_t *val);
+
+// True if a LOAD-FP/STORE-FP width field selects a vector access.
+#define VEC_WIDTH(funct3) ((funct3) == 0b000 || (funct3) >= 0b101)
+
+// Vector load/store. x is the scalar register file. Returns FP_MEM_FAULT on
+// an out-of-bounds access, with the faulting address in fault, and
+// FP_MEM_ILLEGAL, without side effects, for encodings outside the subset.
+enum FpMemStatus vecLoadStore(uint32_t inst, uint32_t *x, uint8_t *mem,
+                              uint32_t mem_size, uint32_t *fault,
+                              char *out_op);
+
+// OP-V instruction, including vsetvl{i}. x is the scalar register file.
+// Returns false, without side effects, for encodings outside the subset.
+bool vecOp(uint32_t inst, uint32_t *x, char *out_op);